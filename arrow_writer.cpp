@@ -0,0 +1,428 @@
+#include "arrow_writer.h"
+
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    // Values from the Arrow format's Schema.fbs and Message.fbs
+    const int16_t metadataVersionV5 = 4;
+    const uint8_t headerSchema = 1;
+    const uint8_t headerDictionaryBatch = 2;
+    const uint8_t headerRecordBatch = 3;
+    const uint8_t typeUtf8 = 5;
+    const uint8_t typeTimestamp = 10;
+    const uint8_t typeList = 12;
+
+    const int64_t folderDictionaryId = 0;
+    const int64_t peopleDictionaryId = 1;
+
+#ifdef _WIN32
+    const char *const pathSeparators = "/\\";
+#else
+    const char *const pathSeparators = "/";
+#endif
+
+    /**
+     * Minimal FlatBuffers builder for Arrow message metadata. Like the reference builder it fills the buffer
+     * back to front, so children are created before the tables that point to them and positions are
+     * distances from the end. Scalars are stored in host byte order, which must be little-endian.
+     */
+    class FlatBuilder
+    {
+    public:
+        uint32_t size() const { return static_cast<uint32_t>(buffer_.size()); }
+
+        void align(size_t alignment, size_t extra = 0)
+        {
+            size_t padding = (alignment - (buffer_.size() + extra) % alignment) % alignment;
+            buffer_.insert(0, padding, '\0');
+        }
+
+        template <typename T>
+        void push(T value)
+        {
+            align(sizeof(T));
+            char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            buffer_.insert(0, bytes, sizeof(T));
+        }
+
+        void pushOffset(uint32_t target)
+        {
+            align(4);
+            push<uint32_t>(size() + 4 - target);
+        }
+
+        uint32_t createString(const std::string &text)
+        {
+            align(4, text.size() + 1);
+            buffer_.insert(0, 1, '\0');
+            buffer_.insert(0, text);
+            push<uint32_t>(static_cast<uint32_t>(text.size()));
+            return size();
+        }
+
+        uint32_t createOffsetVector(const std::vector<uint32_t> &offsets)
+        {
+            for (auto it = offsets.rbegin(); it != offsets.rend(); ++it)
+                pushOffset(*it);
+            push<uint32_t>(static_cast<uint32_t>(offsets.size()));
+            return size();
+        }
+
+        // A vector of structs of two longs (Arrow's FieldNode and Buffer)
+        uint32_t createPairVector(const std::vector<std::pair<int64_t, int64_t>> &items)
+        {
+            align(8, items.size() * 16);
+            for (auto it = items.rbegin(); it != items.rend(); ++it)
+            {
+                push<int64_t>(it->second);
+                push<int64_t>(it->first);
+            }
+            push<uint32_t>(static_cast<uint32_t>(items.size()));
+            return size();
+        }
+
+        void startTable()
+        {
+            fields_.clear();
+            tableEnd_ = size();
+        }
+
+        template <typename T>
+        void addScalar(uint16_t field, T value)
+        {
+            push(value);
+            fields_.push_back({field, size()});
+        }
+
+        void addOffset(uint16_t field, uint32_t target)
+        {
+            pushOffset(target);
+            fields_.push_back({field, size()});
+        }
+
+        uint32_t endTable()
+        {
+            push<int32_t>(0);
+            uint32_t table = size();
+            std::vector<uint16_t> entries;
+            for (const auto &field : fields_)
+            {
+                if (field.first >= entries.size())
+                    entries.resize(field.first + 1, 0);
+                entries[field.first] = static_cast<uint16_t>(table - field.second);
+            }
+            for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+                push<uint16_t>(*it);
+            push<uint16_t>(static_cast<uint16_t>(table - tableEnd_));
+            push<uint16_t>(static_cast<uint16_t>(4 + 2 * entries.size()));
+            // The table starts with the signed distance back to its vtable
+            int32_t vtableDistance = static_cast<int32_t>(size() - table);
+            std::memcpy(&buffer_[buffer_.size() - table], &vtableDistance, sizeof(vtableDistance));
+            return table;
+        }
+
+        std::string finish(uint32_t root)
+        {
+            align(8, 4);
+            pushOffset(root);
+            return buffer_;
+        }
+
+    private:
+        std::string buffer_;
+        std::vector<std::pair<uint16_t, uint32_t>> fields_; // Field index and position
+        uint32_t tableEnd_ = 0;
+    };
+
+    /**
+     * Body of an IPC message: the buffers back to back, each padded to 8 bytes.
+     */
+    struct MessageBody
+    {
+        std::string data;
+        std::vector<std::pair<int64_t, int64_t>> buffers; // Offset and length of each buffer
+
+        void add(const void *bytes, size_t length)
+        {
+            buffers.emplace_back(static_cast<int64_t>(data.size()), static_cast<int64_t>(length));
+            data.append(static_cast<const char *>(bytes), length);
+            data.append((8 - length % 8) % 8, '\0');
+        }
+
+        template <typename T>
+        void add(const std::vector<T> &values)
+        {
+            add(values.data(), values.size() * sizeof(T));
+        }
+
+        // Validity bitmaps may be left out when a column has no nulls
+        void addNoNulls()
+        {
+            buffers.emplace_back(static_cast<int64_t>(data.size()), 0);
+        }
+    };
+}
+
+/**
+ * Builds a RecordBatch table.
+ * @param length Number of rows.
+ * @param nodes Length and null count of each field, depth first.
+ * @param buffers Offset and length of each buffer in the body.
+ * @return The table position.
+ */
+static uint32_t buildRecordBatch(FlatBuilder &fb, int64_t length, const std::vector<std::pair<int64_t, int64_t>> &nodes,
+                                 const std::vector<std::pair<int64_t, int64_t>> &buffers)
+{
+    uint32_t bufferVector = fb.createPairVector(buffers);
+    uint32_t nodeVector = fb.createPairVector(nodes);
+    fb.startTable();
+    fb.addScalar<int64_t>(0, length);
+    fb.addOffset(1, nodeVector);
+    fb.addOffset(2, bufferVector);
+    return fb.endTable();
+}
+
+/**
+ * Builds a non-nullable Field table.
+ * @param typeType The Type union tag.
+ * @param type The type table.
+ * @param dictionaryId Dictionary id for int32-indexed dictionary encoding, or -1.
+ * @param children The child fields.
+ * @return The table position.
+ */
+static uint32_t buildField(FlatBuilder &fb, const std::string &name, uint8_t typeType, uint32_t type,
+                           int64_t dictionaryId, const std::vector<uint32_t> &children)
+{
+    uint32_t nameString = fb.createString(name);
+    uint32_t childVector = fb.createOffsetVector(children);
+    uint32_t dictionary = 0;
+    if (dictionaryId >= 0)
+    {
+        fb.startTable();
+        fb.addScalar<int32_t>(0, 32);
+        fb.addScalar<uint8_t>(1, 1);
+        uint32_t indexType = fb.endTable();
+        fb.startTable();
+        fb.addScalar<int64_t>(0, dictionaryId);
+        fb.addOffset(1, indexType);
+        dictionary = fb.endTable();
+    }
+    fb.startTable();
+    fb.addOffset(0, nameString);
+    fb.addOffset(3, type);
+    if (dictionary)
+        fb.addOffset(4, dictionary);
+    fb.addOffset(5, childVector);
+    fb.addScalar<uint8_t>(2, typeType);
+    return fb.endTable();
+}
+
+/**
+ * Builds a Timestamp type table with second resolution in UTC.
+ */
+static uint32_t buildTimestampType(FlatBuilder &fb)
+{
+    uint32_t timezone = fb.createString("UTC");
+    fb.startTable();
+    fb.addOffset(1, timezone);
+    return fb.endTable();
+}
+
+/**
+ * Builds an empty type table (Utf8 or List).
+ */
+static uint32_t buildEmptyType(FlatBuilder &fb)
+{
+    fb.startTable();
+    return fb.endTable();
+}
+
+/**
+ * Frames a message: continuation marker, metadata length, the Message flatbuffer and the body.
+ * @param fb Builder already holding the header table.
+ * @param headerType The MessageHeader union tag.
+ * @param header The header table.
+ * @param body The message body.
+ * @return The encapsulated message.
+ */
+static std::string encapsulate(FlatBuilder &fb, uint8_t headerType, uint32_t header, const std::string &body)
+{
+    fb.startTable();
+    fb.addScalar<int64_t>(3, static_cast<int64_t>(body.size()));
+    fb.addOffset(2, header);
+    fb.addScalar<int16_t>(0, metadataVersionV5);
+    fb.addScalar<uint8_t>(1, headerType);
+    std::string metadata = fb.finish(fb.endTable());
+
+    uint32_t prefix[2] = {0xFFFFFFFF, static_cast<uint32_t>(metadata.size())};
+    std::string message(reinterpret_cast<const char *>(prefix), sizeof(prefix));
+    message += metadata;
+    message += body;
+    return message;
+}
+
+/**
+ * @param write Receives the encoded stream in chunks (a message or a few at a time).
+ * @param batchRows Rows per record batch.
+ */
+ArrowStreamWriter::ArrowStreamWriter(std::function<void(std::string)> write, size_t batchRows)
+    : write_(std::move(write)), batchRows_(batchRows)
+{
+    fileOffsets_.push_back(0);
+    peopleOffsets_.push_back(0);
+}
+
+/**
+ * @param value A dictionary value.
+ * @return Its index, adding it if it is new.
+ */
+int32_t ArrowStreamWriter::Dictionary::idOf(const std::string &value)
+{
+    auto inserted = ids.emplace(value, static_cast<int32_t>(values.size()));
+    if (inserted.second)
+        values.push_back(value);
+    return inserted.first->second;
+}
+
+/**
+ * Adds a row, writing a record batch when enough rows are pending.
+ * @param record The media file and its metadata.
+ */
+void ArrowStreamWriter::add(const MediaRecord &record)
+{
+    const std::string &path = record.path;
+    size_t separator = path.find_last_of(pathSeparators);
+    size_t folderLength = separator == std::string::npos ? 0 : separator;
+    size_t nameStart = separator == std::string::npos ? 0 : separator + 1;
+    // Records arrive a directory at a time, so the last folder usually matches
+    if (lastFolderId_ < 0 || lastFolder_.compare(0, std::string::npos, path, 0, folderLength) != 0)
+    {
+        lastFolder_.assign(path, 0, folderLength);
+        lastFolderId_ = folders_.idOf(lastFolder_);
+    }
+    folderIds_.push_back(lastFolderId_);
+    fileData_.append(path, nameStart, std::string::npos);
+    fileOffsets_.push_back(static_cast<int32_t>(fileData_.size()));
+    takenTimes_.push_back(static_cast<int64_t>(record.photoTakenTime));
+    uploadTimes_.push_back(static_cast<int64_t>(record.creationTime));
+    for (const auto &name : record.peopleNames)
+        peopleIds_.push_back(people_.idOf(name));
+    peopleOffsets_.push_back(static_cast<int32_t>(peopleIds_.size()));
+
+    if (takenTimes_.size() >= batchRows_)
+        writeBatch();
+}
+
+/**
+ * Writes the pending rows and the end-of-stream marker. Without any rows the stream holds just the schema.
+ */
+void ArrowStreamWriter::finish()
+{
+    writeBatch();
+    if (!schemaWritten_)
+        writeSchema();
+    const uint32_t endOfStream[2] = {0xFFFFFFFF, 0};
+    write_(std::string(reinterpret_cast<const char *>(endOfStream), sizeof(endOfStream)));
+}
+
+/**
+ * Writes the Schema message that opens the stream.
+ */
+void ArrowStreamWriter::writeSchema()
+{
+    FlatBuilder fb;
+    std::vector<uint32_t> fields;
+    fields.push_back(buildField(fb, "folder", typeUtf8, buildEmptyType(fb), folderDictionaryId, {}));
+    fields.push_back(buildField(fb, "file", typeUtf8, buildEmptyType(fb), -1, {}));
+    fields.push_back(buildField(fb, "photo_taken_time", typeTimestamp, buildTimestampType(fb), -1, {}));
+    fields.push_back(buildField(fb, "upload_time", typeTimestamp, buildTimestampType(fb), -1, {}));
+    uint32_t item = buildField(fb, "item", typeUtf8, buildEmptyType(fb), peopleDictionaryId, {});
+    fields.push_back(buildField(fb, "people", typeList, buildEmptyType(fb), -1, {item}));
+    uint32_t fieldVector = fb.createOffsetVector(fields);
+    fb.startTable();
+    fb.addOffset(1, fieldVector);
+    uint32_t schema = fb.endTable();
+    write_(encapsulate(fb, headerSchema, schema, std::string()));
+    schemaWritten_ = true;
+}
+
+/**
+ * Writes the dictionary values added since the last call: the full dictionary the first time, then deltas.
+ * @param id The dictionary id from the schema.
+ * @param dictionary The dictionary.
+ */
+void ArrowStreamWriter::writeDictionary(int64_t id, Dictionary &dictionary)
+{
+    if (dictionary.sent && dictionary.written == dictionary.values.size())
+        return;
+
+    std::vector<int32_t> offsets{0};
+    std::string data;
+    for (size_t i = dictionary.written; i < dictionary.values.size(); ++i)
+    {
+        data += dictionary.values[i];
+        offsets.push_back(static_cast<int32_t>(data.size()));
+    }
+    int64_t count = static_cast<int64_t>(offsets.size() - 1);
+    MessageBody body;
+    body.addNoNulls();
+    body.add(offsets);
+    body.add(data.data(), data.size());
+
+    FlatBuilder fb;
+    uint32_t batch = buildRecordBatch(fb, count, {{count, 0}}, body.buffers);
+    fb.startTable();
+    fb.addScalar<int64_t>(0, id);
+    fb.addOffset(1, batch);
+    fb.addScalar<uint8_t>(2, dictionary.sent ? 1 : 0);
+    uint32_t header = fb.endTable();
+    write_(encapsulate(fb, headerDictionaryBatch, header, body.data));
+    dictionary.written = dictionary.values.size();
+    dictionary.sent = true;
+}
+
+/**
+ * Writes the pending rows as a record batch, preceded by the schema and dictionary batches it needs.
+ */
+void ArrowStreamWriter::writeBatch()
+{
+    int64_t rows = static_cast<int64_t>(takenTimes_.size());
+    if (rows == 0)
+        return;
+    if (!schemaWritten_)
+        writeSchema();
+    writeDictionary(folderDictionaryId, folders_);
+    writeDictionary(peopleDictionaryId, people_);
+
+    MessageBody body;
+    body.addNoNulls();
+    body.add(folderIds_);
+    body.addNoNulls();
+    body.add(fileOffsets_);
+    body.add(fileData_.data(), fileData_.size());
+    body.addNoNulls();
+    body.add(takenTimes_);
+    body.addNoNulls();
+    body.add(uploadTimes_);
+    body.addNoNulls();
+    body.add(peopleOffsets_);
+    body.addNoNulls();
+    body.add(peopleIds_);
+
+    std::vector<std::pair<int64_t, int64_t>> nodes(5, {rows, 0});
+    nodes.push_back({static_cast<int64_t>(peopleIds_.size()), 0});
+    FlatBuilder fb;
+    uint32_t header = buildRecordBatch(fb, rows, nodes, body.buffers);
+    write_(encapsulate(fb, headerRecordBatch, header, body.data));
+
+    folderIds_.clear();
+    fileOffsets_.assign(1, 0);
+    fileData_.clear();
+    takenTimes_.clear();
+    uploadTimes_.clear();
+    peopleOffsets_.assign(1, 0);
+    peopleIds_.clear();
+}
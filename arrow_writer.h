@@ -0,0 +1,63 @@
+#ifndef ARROW_WRITER_H
+#define ARROW_WRITER_H
+
+#include "sidecar.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Writes media records as an Arrow IPC stream (columnar format, metadata version 5) without the Arrow
+ * libraries. Columns:
+ * - folder: dictionary<int32, utf8>, the directory of the file;
+ * - file: utf8, the file name;
+ * - photo_taken_time, upload_time: timestamp[s, UTC];
+ * - people: list<dictionary<int32, utf8>>.
+ * Rows are collected into record batches; folder and people names first seen in a batch are sent as
+ * dictionary deltas just before it.
+ */
+class ArrowStreamWriter
+{
+public:
+    explicit ArrowStreamWriter(std::function<void(std::string)> write, size_t batchRows = 65536);
+
+    void add(const MediaRecord &record);
+    void finish();
+
+private:
+    struct Dictionary
+    {
+        std::unordered_map<std::string, int32_t> ids;
+        std::vector<std::string> values;
+        size_t written = 0; // Values already sent
+        bool sent = false;  // The first (non-delta) batch has been sent
+
+        int32_t idOf(const std::string &value);
+    };
+
+    void writeSchema();
+    void writeDictionary(int64_t id, Dictionary &dictionary);
+    void writeBatch();
+
+    std::function<void(std::string)> write_;
+    size_t batchRows_;
+    bool schemaWritten_ = false;
+    Dictionary folders_;
+    Dictionary people_;
+    std::string lastFolder_;
+    int32_t lastFolderId_ = -1;
+
+    // Columns of the pending record batch
+    std::vector<int32_t> folderIds_;
+    std::vector<int32_t> fileOffsets_;
+    std::string fileData_;
+    std::vector<int64_t> takenTimes_;
+    std::vector<int64_t> uploadTimes_;
+    std::vector<int32_t> peopleOffsets_;
+    std::vector<int32_t> peopleIds_;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <chrono>
+#include <thread>
+
+/**
+ * Waits with backoff for lock-free handoffs: spin briefly, then yield, then sleep,
+ * so idle threads do not burn a core.
+ */
+class Backoff
+{
+public:
+    void pause()
+    {
+        if (++spins_ < 64)
+            return;
+        if (spins_ < 256)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    void reset() { spins_ = 0; }
+
+private:
+    unsigned spins_ = 0;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Checks that the system calls per sidecar stay within bench/syscall_budget.json (Linux).
+
+Every photo in the generated trees is a Live Photo with an .MP4 companion, which is the most
+expensive case. Each mode runs on two tree sizes under takeout_syscall_count (ptrace), and the
+difference is divided by the difference in sidecars. That leaves only the per-file cost, without
+process startup and fixed overhead.
+
+Exits with status 1 if any call class is over budget. After an intentional change, run with
+--update to rewrite the budget from the current numbers.
+"""
+
+import argparse
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+BUDGET_FILE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "syscall_budget.json")
+
+MODES = {
+    "list": ["--list"],
+    "list-tags": ["--list-tags"],
+    "set-file-dates": ["--set-file-dates"],
+}
+
+# Kernel call names grouped into the classes the budget tracks
+CLASSES = {
+    "stat": ["stat", "lstat", "newfstatat", "statx", "fstat"],
+    "open": ["open", "openat"],
+    "read": ["read", "pread64"],
+    "close": ["close"],
+    "seek": ["lseek"],
+    "set-times": ["utimensat"],
+    "xattr": ["setxattr"],
+}
+
+SIZES = (200, 400)
+
+
+def count_calls(build, tree, args):
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as f:
+        counts_path = f.name
+    try:
+        subprocess.run([os.path.join(build, "takeout_syscall_count"), counts_path,
+                        os.path.join(build, "takeout_photos_date_setter"), tree] + args,
+                       check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        with open(counts_path) as f:
+            counts = json.load(f)
+    finally:
+        os.unlink(counts_path)
+    classes = {name: sum(counts["calls"].get(call, 0) for call in calls) for name, calls in CLASSES.items()}
+    classes["total"] = counts["total"]
+    return classes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--build", default="build", help="build folder with the tool, takeout_generator and takeout_syscall_count")
+    parser.add_argument("--update", action="store_true", help="rewrite the budget from the current numbers")
+    options = parser.parse_args()
+
+    scratch = tempfile.mkdtemp(prefix="takeout_budget_")
+    try:
+        trees = []
+        for size in SIZES:
+            tree = os.path.join(scratch, str(size))
+            subprocess.run([os.path.join(options.build, "takeout_generator"), tree, "--files", str(size),
+                            "--albums", "0", "--live-share", "1", "--long-name-share", "0"],
+                           check=True, stdout=subprocess.DEVNULL)
+            trees.append(tree)
+
+        measured = {}
+        for mode, args in MODES.items():
+            # set-file-dates changes the trees, but not their shape, so the order of modes does not matter
+            small, large = (count_calls(options.build, tree, args) for tree in trees)
+            measured[mode] = {name: (large[name] - small[name]) / (SIZES[1] - SIZES[0]) for name in small}
+    finally:
+        shutil.rmtree(scratch, ignore_errors=True)
+
+    if options.update:
+        # Round up to a tenth of a call so counting noise does not fail the check
+        budget = {mode: {name: math.ceil(value * 10 - 1e-9) / 10 for name, value in classes.items() if value > 0}
+                  for mode, classes in measured.items()}
+        with open(BUDGET_FILE, "w") as f:
+            json.dump(budget, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print(f"Wrote {BUDGET_FILE}")
+        return 0
+
+    with open(BUDGET_FILE) as f:
+        budget = json.load(f)
+    failures = 0
+    print(f"{'mode':<16}{'class':<11}{'per file':>10}{'budget':>9}")
+    for mode, classes in measured.items():
+        for name, value in classes.items():
+            limit = budget.get(mode, {}).get(name, 0)
+            over = value > limit + 1e-9
+            if value > 0 or limit > 0:
+                print(f"{mode:<16}{name:<11}{value:>10.2f}{limit:>9.1f}{'  OVER BUDGET' if over else ''}")
+            failures += over
+    if failures:
+        print(f"{failures} call classes over budget", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
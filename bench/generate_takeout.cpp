@@ -0,0 +1,275 @@
+// Generates a synthetic Google Photos Takeout tree for reproducible performance testing.
+// The same options and seed always produce the same tree, on every platform.
+
+#include "synthetic.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/**
+ * Generator settings, filled from the command line.
+ */
+struct GeneratorOptions
+{
+    uint64_t files = 10000;         // Primary media files in the year folders
+    unsigned years = 10;            // "Photos from YYYY" folders the files are spread over
+    unsigned albums = 20;           // Album folders
+    double albumShare = 0.1;        // Fraction of photos also copied (with their own sidecar) into an album
+    double liveShare = 0.15;        // Fraction of photos that are Live Photos with an '.MP4' companion
+    double supplShare = 0.2;        // Fraction of sidecars named '.suppl.json'
+    double longNameShare = 0.05;    // Fraction of files with long Pixel names whose sidecar name gets truncated
+    unsigned people = 50;           // Distinct people names
+    double peopleShare = 0.3;       // Fraction of photos with 1 to 3 people
+    uint64_t mediaSize = 0;         // Size of each media file; non-zero sizes are created sparse
+    uint64_t seed = 1;
+};
+
+/**
+ * Writes a whole file.
+ * @return False on failure.
+ */
+static bool writeFile(const fs::path &path, const std::string &text)
+{
+    std::FILE *file = std::fopen(path.string().c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+/**
+ * Creates a media file of the configured size. Non-empty files are extended without writing data, so
+ * most file systems store them sparse.
+ * @return False on failure.
+ */
+static bool writeMediaFile(const fs::path &path, uint64_t size)
+{
+    if (!writeFile(path, std::string()))
+        return false;
+    if (size == 0)
+        return true;
+    std::error_code ec;
+    fs::resize_file(path, size, ec);
+    return !ec;
+}
+
+/**
+ * Totals reported at the end.
+ */
+struct GeneratorCounts
+{
+    uint64_t mediaFiles = 0;
+    uint64_t sidecars = 0;
+    uint64_t companions = 0;
+    uint64_t truncatedSidecars = 0;
+};
+
+/**
+ * Writes a photo (media file, sidecar and Live Photo companion) into a folder.
+ * @return False on failure.
+ */
+static bool writePhoto(const fs::path &folder, const SyntheticPhoto &photo, const GeneratorOptions &options, Random &random,
+                       GeneratorCounts &counts)
+{
+    bool suppl = random.chance(options.supplShare);
+    std::string jsonName = takeoutSidecarName(photo.mediaName, suppl);
+    if (jsonName.find(suppl ? ".suppl.json" : ".supplemental-metadata.json") == std::string::npos)
+        ++counts.truncatedSidecars;
+    if (!writeMediaFile(folder / photo.mediaName, options.mediaSize) ||
+        !writeFile(folder / jsonName, takeoutSidecarJSON(photo, random)))
+        return false;
+    counts.mediaFiles++;
+    counts.sidecars++;
+    if (photo.live)
+    {
+        std::string stem = photo.mediaName.substr(0, photo.mediaName.rfind('.'));
+        if (!writeMediaFile(folder / (stem + ".MP4"), options.mediaSize))
+            return false;
+        counts.companions++;
+    }
+    return true;
+}
+
+/**
+ * Parses a non-negative number option value.
+ */
+static bool parseNumber(const char *text, uint64_t &value)
+{
+    char *end = nullptr;
+    unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (!*text || *end)
+        return false;
+    value = parsed;
+    return true;
+}
+
+/**
+ * Parses a fraction option value in [0, 1].
+ */
+static bool parseShare(const char *text, double &value)
+{
+    char *end = nullptr;
+    double parsed = std::strtod(text, &end);
+    if (!*text || *end || parsed < 0 || parsed > 1)
+        return false;
+    value = parsed;
+    return true;
+}
+
+/**
+ * Prints the command-line usage help message.
+ */
+static void printHelp()
+{
+    std::cout << "Usage: takeout_generator <output-folder> [options]\n"
+              << "Options:\n"
+              << "  --files <n>              Primary media files (default 10000)\n"
+              << "  --years <n>              'Photos from YYYY' folders (default 10)\n"
+              << "  --albums <n>             Album folders (default 20)\n"
+              << "  --album-share <f>        Fraction of photos duplicated into an album (default 0.1)\n"
+              << "  --live-share <f>         Fraction of Live Photos with an .MP4 companion (default 0.15)\n"
+              << "  --suppl-share <f>        Fraction of sidecars named .suppl.json (default 0.2)\n"
+              << "  --long-name-share <f>    Fraction of long names whose sidecar name is truncated (default 0.05)\n"
+              << "  --people <n>             Distinct people names (default 50)\n"
+              << "  --people-share <f>       Fraction of photos with people (default 0.3)\n"
+              << "  --media-size <bytes>     Size of each (sparse) media file (default 0)\n"
+              << "  --seed <n>               Random seed (default 1)\n";
+}
+
+/**
+ * Generates the tree described by the command line.
+ * @return 0 on success, 1 on error.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || std::strcmp(argv[1], "--help") == 0)
+    {
+        printHelp();
+        return argc < 2 ? 1 : 0;
+    }
+
+    fs::path root = argv[1];
+    GeneratorOptions options;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        uint64_t number = 0;
+        bool ok = i + 1 < argc;
+        const char *value = ok ? argv[++i] : "";
+        if (arg == "--files")
+            ok = ok && parseNumber(value, options.files);
+        else if (arg == "--years")
+        {
+            ok = ok && parseNumber(value, number) && number > 0;
+            options.years = static_cast<unsigned>(number);
+        }
+        else if (arg == "--albums")
+        {
+            ok = ok && parseNumber(value, number);
+            options.albums = static_cast<unsigned>(number);
+        }
+        else if (arg == "--album-share")
+            ok = ok && parseShare(value, options.albumShare);
+        else if (arg == "--live-share")
+            ok = ok && parseShare(value, options.liveShare);
+        else if (arg == "--suppl-share")
+            ok = ok && parseShare(value, options.supplShare);
+        else if (arg == "--long-name-share")
+            ok = ok && parseShare(value, options.longNameShare);
+        else if (arg == "--people")
+        {
+            ok = ok && parseNumber(value, number) && number > 0;
+            options.people = static_cast<unsigned>(number);
+        }
+        else if (arg == "--people-share")
+            ok = ok && parseShare(value, options.peopleShare);
+        else if (arg == "--media-size")
+            ok = ok && parseNumber(value, options.mediaSize);
+        else if (arg == "--seed")
+            ok = ok && parseNumber(value, options.seed);
+        else
+            ok = false;
+        if (!ok)
+        {
+            std::cerr << "Unknown option or invalid value: " << arg << std::endl;
+            printHelp();
+            return 1;
+        }
+    }
+
+    std::vector<std::string> peopleNames;
+    for (unsigned i = 0; i < options.people; ++i)
+        peopleNames.push_back("Person " + std::to_string(i + 1));
+
+    Random random(options.seed);
+    fs::path photosRoot = root / "Takeout" / "Google Photos";
+    std::vector<fs::path> albumFolders;
+    std::error_code ec;
+    for (unsigned i = 0; i < options.years; ++i)
+        fs::create_directories(photosRoot / ("Photos from " + std::to_string(2024 - options.years + 1 + i)), ec);
+    for (unsigned i = 0; i < options.albums && !ec; ++i)
+    {
+        albumFolders.push_back(photosRoot / ("Album " + std::to_string(i + 1)));
+        fs::create_directories(albumFolders.back(), ec);
+    }
+    if (ec)
+    {
+        std::cerr << "Failed to create folders under " << photosRoot << ": " << ec.message() << std::endl;
+        return 1;
+    }
+
+    GeneratorCounts counts;
+    const int64_t yearSeconds = 365 * 24 * 3600;
+    for (uint64_t n = 0; n < options.files; ++n)
+    {
+        unsigned year = static_cast<unsigned>(n * options.years / options.files);
+        int64_t yearStart = (2024 - options.years + 1 + year - 1970) * yearSeconds;
+
+        SyntheticPhoto photo;
+        photo.takenTime = yearStart + static_cast<int64_t>(random.below(yearSeconds));
+        photo.uploadTime = photo.takenTime + static_cast<int64_t>(random.below(30 * 24 * 3600));
+        photo.live = random.chance(options.liveShare);
+        char name[64];
+        if (random.chance(options.longNameShare))
+            std::snprintf(name, sizeof(name), "PXL_%04u0101_%09llu.MP.jpg", 2024 - options.years + 1 + year,
+                          static_cast<unsigned long long>(n));
+        else
+            std::snprintf(name, sizeof(name), "IMG_%06llu.%s", static_cast<unsigned long long>(n),
+                          photo.live ? "HEIC" : (n % 3 ? "JPG" : "HEIC"));
+        photo.mediaName = name;
+        if (random.chance(options.peopleShare))
+        {
+            uint64_t count = 1 + random.below(3);
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                const std::string &person = peopleNames[pickPerson(random, options.people)];
+                if (std::find(photo.people.begin(), photo.people.end(), person) == photo.people.end())
+                    photo.people.push_back(person);
+            }
+        }
+
+        fs::path folder = photosRoot / ("Photos from " + std::to_string(2024 - options.years + 1 + year));
+        if (!writePhoto(folder, photo, options, random, counts) ||
+            (!albumFolders.empty() && random.chance(options.albumShare) &&
+             !writePhoto(albumFolders[random.below(albumFolders.size())], photo, options, random, counts)))
+        {
+            std::cerr << "Failed to write " << photo.mediaName << " in " << folder << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Generated " << counts.mediaFiles << " media files, " << counts.sidecars << " sidecars ("
+              << counts.truncatedSidecars << " with truncated names), " << counts.companions << " companions under "
+              << photosRoot.string() << "\n";
+    return 0;
+}
@@ -0,0 +1,299 @@
+// Microbenchmarks for the per-file primitives. Prints a table, and with '--json <file>' writes the results
+// in a machine-readable form so runs can be compared across commits.
+
+#include "synthetic.h"
+#include "../external_sort.h"
+#include "../format.h"
+#include "../json_scan.h"
+#include "../list_columns.h"
+#include "../sidecar.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Each measurement runs for at least this long; the median of several measurements is reported.
+    const double minMeasurementSeconds = 0.05;
+    const int repetitions = 5;
+
+    // Results are folded into this so the compiler cannot drop the measured work.
+    volatile uint64_t sink = 0;
+
+    /**
+     * Median time per operation of one benchmark.
+     */
+    struct BenchResult
+    {
+        std::string name;
+        double nsPerOp;
+        uint64_t operations;
+    };
+}
+
+/**
+ * Times a benchmark body. The body is run with an iteration count and must do that many iterations
+ * of 'opsPerIteration' operations each; the count is doubled until one run takes long enough.
+ * @param name Benchmark name.
+ * @param opsPerIteration Operations done by one iteration (e.g. the number of sampled inputs).
+ * @param body The measured code.
+ * @return The median time per operation.
+ */
+static BenchResult runBenchmark(const std::string &name, uint64_t opsPerIteration,
+                                const std::function<void(uint64_t)> &body)
+{
+    using Clock = std::chrono::steady_clock;
+    uint64_t iterations = 1;
+    for (;;)
+    {
+        auto start = Clock::now();
+        body(iterations);
+        if (std::chrono::duration<double>(Clock::now() - start).count() >= minMeasurementSeconds)
+            break;
+        iterations *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int i = 0; i < repetitions; ++i)
+    {
+        auto start = Clock::now();
+        body(iterations);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        samples.push_back(ns / static_cast<double>(iterations * opsPerIteration));
+    }
+    std::sort(samples.begin(), samples.end());
+    return {name, samples[samples.size() / 2], iterations * opsPerIteration};
+}
+
+/**
+ * Writes a whole file.
+ */
+static void writeFile(const fs::path &path, const std::string &text)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+/**
+ * Runs all benchmarks whose name contains the filter.
+ * @return 0 on success, 1 on error.
+ */
+int main(int argc, char *argv[])
+{
+    std::string jsonPath;
+    std::string filter;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else
+        {
+            std::cerr << "Usage: takeout_microbench [--json <file>] [--filter <substring>]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Real-shaped inputs: the same photos and sidecars takeout_generator writes
+    const size_t sampleCount = 256;
+    Random random(42);
+    std::vector<SyntheticPhoto> photos(sampleCount);
+    std::vector<std::string> sidecarTexts, sidecarNames, fileNames, paths;
+    std::vector<std::vector<std::string>> peopleLists;
+    for (size_t i = 0; i < sampleCount; ++i)
+    {
+        SyntheticPhoto &photo = photos[i];
+        photo.mediaName = (i % 20 == 0 ? "PXL_20210101_" + std::to_string(100000000 + i) + ".MP.jpg"
+                                       : "IMG_" + std::to_string(1000 + i) + (i % 3 ? ".JPG" : ".HEIC"));
+        photo.takenTime = 1300000000 + static_cast<int64_t>(random.below(400000000));
+        photo.uploadTime = photo.takenTime + static_cast<int64_t>(random.below(2592000));
+        photo.live = random.chance(0.15);
+        if (random.chance(0.3))
+        {
+            for (uint64_t p = 0, n = 1 + random.below(3); p < n; ++p)
+                photo.people.push_back("Person " + std::to_string(pickPerson(random, 50) + 1));
+        }
+        sidecarTexts.push_back(takeoutSidecarJSON(photo, random));
+        sidecarNames.push_back(takeoutSidecarName(photo.mediaName, random.chance(0.2)));
+        fileNames.push_back(photo.mediaName);
+        fileNames.push_back(sidecarNames.back());
+        paths.push_back("Takeout/Google Photos/Photos from 2021/" + photo.mediaName);
+        peopleLists.push_back(photo.people);
+    }
+
+    // A small on-disk tree for the benchmarks that touch the file system
+    fs::path tree = fs::temp_directory_path() / ("takeout_microbench_" + std::to_string(random.next() % 1000000));
+    fs::create_directories(tree);
+    std::vector<fs::path> sidecarPaths, primaryPaths;
+    for (size_t i = 0; i < sampleCount; ++i)
+    {
+        std::string jsonName = photos[i].mediaName + ".supplemental-metadata.json";
+        writeFile(tree / photos[i].mediaName, "");
+        writeFile(tree / jsonName, sidecarTexts[i]);
+        if (photos[i].live)
+            writeFile(tree / (photos[i].mediaName.substr(0, photos[i].mediaName.rfind('.')) + ".MP4"), "");
+        sidecarPaths.push_back(tree / jsonName);
+        primaryPaths.push_back(tree / photos[i].mediaName);
+    }
+
+    std::vector<std::pair<std::string, std::function<BenchResult()>>> benchmarks = {
+        {"sidecar/parse_dom", [&]
+         { return runBenchmark("sidecar/parse_dom", sampleCount, [&](uint64_t iterations)
+                               {
+              SidecarMetadata meta;
+              for (uint64_t n = 0; n < iterations; ++n)
+                  for (size_t i = 0; i < sampleCount; ++i)
+                      sink += static_cast<uint64_t>(parseSidecar(sidecarTexts[i], sidecarPaths[i], meta)) + meta.peopleNames.size(); }); }},
+        {"sidecar/scan_fields", [&]
+         { return runBenchmark("sidecar/scan_fields", sampleCount, [&](uint64_t iterations)
+                               {
+              const std::vector<std::string> fields = {"geoData", "description", "people"};
+              std::string out;
+              for (uint64_t n = 0; n < iterations; ++n)
+                  for (size_t i = 0; i < sampleCount; ++i)
+                  {
+                      const std::string &text = sidecarTexts[i];
+                      out.clear();
+                      for (const auto &field : fields)
+                      {
+                          JSONSpan value;
+                          if (findJSONMember(text.data(), text.data() + text.size(), field, value))
+                              appendCompactJSON(out, value);
+                      }
+                      sink += out.size();
+                  } }); }},
+        {"sidecar/read_and_parse", [&]
+         { return runBenchmark("sidecar/read_and_parse", sampleCount, [&](uint64_t iterations)
+                               {
+              SidecarMetadata meta;
+              for (uint64_t n = 0; n < iterations; ++n)
+                  for (size_t i = 0; i < sampleCount; ++i)
+                      sink += static_cast<uint64_t>(readSidecar(sidecarPaths[i], meta)); }); }},
+        {"sidecar/is_sidecar_name", [&]
+         { return runBenchmark("sidecar/is_sidecar_name", fileNames.size(), [&](uint64_t iterations)
+                               {
+              for (uint64_t n = 0; n < iterations; ++n)
+                  for (const auto &name : fileNames)
+                      sink += isSidecarName(name); }); }},
+        {"sidecar/find_companions", [&]
+         { return runBenchmark("sidecar/find_companions", sampleCount, [&](uint64_t iterations)
+                               {
+              std::vector<fs::path> companions;
+              for (uint64_t n = 0; n < iterations; ++n)
+                  for (const auto &primary : primaryPaths)
+                  {
+                      companions.clear();
+                      findCompanions(primary, companions);
+                      sink += companions.size();
+                  } }); }},
+        {"format/format_time", [&]
+         { return runBenchmark("format/format_time", sampleCount, [&](uint64_t iterations)
+                               {
+              for (uint64_t n = 0; n < iterations; ++n)
+                  for (const auto &photo : photos)
+                      sink += formatTime(static_cast<time_t>(photo.takenTime)).size(); }); }},
+        {"format/escape_csv", [&]
+         { return runBenchmark("format/escape_csv", sampleCount, [&](uint64_t iterations)
+                               {
+              for (uint64_t n = 0; n < iterations; ++n)
+                  for (const auto &path : paths)
+                      sink += escapeCSV(path).size(); }); }},
+        {"format/join_csv", [&]
+         { return runBenchmark("format/join_csv", sampleCount, [&](uint64_t iterations)
+                               {
+              for (uint64_t n = 0; n < iterations; ++n)
+                  for (const auto &people : peopleLists)
+                      sink += joinCSV(people, ";").size(); }); }},
+        {"format/list_row", [&]
+         { return runBenchmark("format/list_row", sampleCount, [&](uint64_t iterations)
+                               {
+              std::string out;
+              for (uint64_t n = 0; n < iterations; ++n)
+              {
+                  out.clear();
+                  for (size_t i = 0; i < sampleCount; ++i)
+                      appendListRow(out, paths[i], photos[i].takenTime, photos[i].uploadTime, peopleLists[i]);
+                  sink += out.size();
+              } }); }},
+        {"format/list_row_columns", [&]
+         { return runBenchmark("format/list_row_columns", sampleCount, [&](uint64_t iterations)
+                               {
+              // '--columns path,taken': the unselected columns are never formatted
+              ListRowWriter writer;
+              writer.selectColumns("path,taken");
+              std::vector<MediaRecord> records(sampleCount);
+              for (size_t i = 0; i < sampleCount; ++i)
+              {
+                  records[i].path = paths[i];
+                  records[i].photoTakenTime = photos[i].takenTime;
+                  records[i].creationTime = photos[i].uploadTime;
+                  records[i].peopleNames = peopleLists[i];
+              }
+              std::string out;
+              for (uint64_t n = 0; n < iterations; ++n)
+              {
+                  out.clear();
+                  for (const auto &record : records)
+                      writer.appendRow(out, record);
+                  sink += out.size();
+              } }); }},
+        {"tags/accumulate", [&]
+         { return runBenchmark("tags/accumulate", sampleCount, [&](uint64_t iterations)
+                               {
+              // The '--list-tags' path: every sidecar's names go into a de-duplicating sorter
+              for (uint64_t n = 0; n < iterations; ++n)
+              {
+                  ExternalSorter tags(SIZE_MAX, true);
+                  for (const auto &people : peopleLists)
+                      for (const auto &name : people)
+                          tags.add(name);
+                  tags.forEach([](const std::string &tag)
+                               { sink += tag.size(); });
+              } }); }},
+    };
+
+    std::vector<BenchResult> results;
+    std::cout << std::left << std::setw(28) << "Benchmark" << std::right << std::setw(14) << "ns/op" << "\n";
+    for (const auto &benchmark : benchmarks)
+    {
+        if (!filter.empty() && benchmark.first.find(filter) == std::string::npos)
+            continue;
+        results.push_back(benchmark.second());
+        std::cout << std::left << std::setw(28) << results.back().name << std::right << std::setw(14)
+                  << std::fixed << std::setprecision(1) << results.back().nsPerOp << std::endl;
+    }
+    std::error_code ec;
+    fs::remove_all(tree, ec);
+
+    if (!jsonPath.empty())
+    {
+        std::ofstream out(jsonPath, std::ios::trunc);
+        if (!out.is_open())
+        {
+            std::cerr << "Failed to open " << jsonPath << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        out << "{\"benchmarks\":[";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            out << (i ? "," : "") << "\n  {\"name\":" << escapeJSON(results[i].name) << ",\"ns_per_op\":"
+                << results[i].nsPerOp << ",\"operations\":" << results[i].operations << "}";
+        }
+        out << "\n]}\n";
+    }
+    return 0;
+}
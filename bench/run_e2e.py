@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""End-to-end benchmark for takeout_photos_date_setter.
+
+Runs each mode against a generated Takeout tree and records wall time, per-file cost, system call
+counts (from --stats-json) and peak RSS. Warm runs repeat on a populated page cache; cold runs drop
+the cache first, either through the OS (Linux drop_caches or macOS purge, which need root) or by
+unmounting and remounting a loop-mounted image that holds the tree (--loop-image, Linux and root only).
+
+Save a run with --save and compare later runs against it with --compare to see what a change did
+to the per-file cost.
+"""
+
+import argparse
+import json
+import os
+import platform
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+MODES = {
+    "list": ["--list"],
+    "list-sorted": ["--list", "--sort", "taken"],
+    "list-tags": ["--list-tags"],
+    "set-file-dates": ["--set-file-dates"],
+}
+
+
+def run(command, **kwargs):
+    return subprocess.run(command, check=True, **kwargs)
+
+
+class CacheDropper:
+    """Empties the page cache between cold runs, or reports why it cannot."""
+
+    def __init__(self, loop_image, mount_point):
+        self.loop_image = loop_image
+        self.mount_point = mount_point
+
+    def drop(self):
+        if self.loop_image:
+            run(["umount", self.mount_point])
+            run(["mount", "-o", "loop", self.loop_image, self.mount_point])
+            return True
+        try:
+            if platform.system() == "Linux":
+                os.sync()
+                with open("/proc/sys/vm/drop_caches", "w") as f:
+                    f.write("3\n")
+                return True
+            if platform.system() == "Darwin":
+                run(["purge"], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+                return True
+        except (OSError, subprocess.CalledProcessError):
+            pass
+        return False
+
+
+def make_loop_image(path, size_mb, mount_point):
+    run(["truncate", "-s", f"{size_mb}M", path])
+    run(["mkfs.ext4", "-q", "-F", path])
+    os.makedirs(mount_point, exist_ok=True)
+    run(["mount", "-o", "loop", path, mount_point])
+
+
+def run_mode(tool, tree, args, jobs):
+    """Runs the tool once and returns wall seconds and its --stats-json record."""
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as f:
+        stats_path = f.name
+    try:
+        command = [tool, tree] + args + ["--jobs", str(jobs), "--stats-json", stats_path]
+        start = time.perf_counter()
+        run(command, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        wall = time.perf_counter() - start
+        with open(stats_path) as f:
+            return wall, json.load(f)
+    finally:
+        os.unlink(stats_path)
+
+
+def summarize(mode, cache, walls, stats):
+    counters = stats["counters"]
+    sidecars = max(counters["sidecars_parsed"], 1)
+    syscalls = sum(v for k, v in counters.items() if k.endswith("_calls"))
+    wall = statistics.median(walls)
+    return {
+        "mode": mode,
+        "cache": cache,
+        "runs": len(walls),
+        "wall_seconds": wall,
+        "us_per_sidecar": wall * 1e6 / sidecars,
+        "syscalls_per_sidecar": syscalls / sidecars,
+        "sidecars": counters["sidecars_parsed"],
+        "peak_rss_bytes": stats["peak_rss_bytes"],
+        "counters": counters,
+    }
+
+
+def print_table(results, baseline):
+    by_key = {(r["mode"], r["cache"]): r for r in (baseline or {}).get("results", [])}
+    print(f"{'mode':<16}{'cache':<7}{'wall s':>9}{'us/file':>10}{'calls/file':>12}{'RSS MB':>9}"
+          + (f"{'vs base':>10}" if baseline else ""))
+    for r in results:
+        line = (f"{r['mode']:<16}{r['cache']:<7}{r['wall_seconds']:>9.3f}{r['us_per_sidecar']:>10.2f}"
+                f"{r['syscalls_per_sidecar']:>12.2f}{r['peak_rss_bytes'] / 2**20:>9.1f}")
+        base = by_key.get((r["mode"], r["cache"]))
+        if base:
+            line += f"{(r['us_per_sidecar'] / base['us_per_sidecar'] - 1) * 100:>+9.1f}%"
+        print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--build", default="build", help="build folder with the tool and takeout_generator")
+    parser.add_argument("--tree", help="existing tree to use (default: generate one in a temporary folder)")
+    parser.add_argument("--files", type=int, default=100000, help="photos to generate (default 100000)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--modes", default=",".join(MODES), help="comma-separated modes (default all)")
+    parser.add_argument("--jobs", type=int, default=1)
+    parser.add_argument("--runs", type=int, default=3, help="runs per mode and cache state (default 3)")
+    parser.add_argument("--cache", choices=["warm", "cold", "both"], default="both")
+    parser.add_argument("--loop-image", help="generate the tree on a loop-mounted ext4 image at this path "
+                        "and remount it for cold runs (Linux, root)")
+    parser.add_argument("--image-size-mb", type=int, default=4096)
+    parser.add_argument("--save", help="write the results as JSON (e.g. a baseline)")
+    parser.add_argument("--compare", help="baseline JSON to compare per-file cost against")
+    options = parser.parse_args()
+
+    exe = ".exe" if os.name == "nt" else ""
+    tool = os.path.join(options.build, "takeout_photos_date_setter" + exe)
+    generator = os.path.join(options.build, "takeout_generator" + exe)
+    modes = options.modes.split(",")
+    unknown = [m for m in modes if m not in MODES]
+    if unknown:
+        parser.error(f"unknown mode(s): {', '.join(unknown)}")
+
+    scratch = tempfile.mkdtemp(prefix="takeout_e2e_")
+    mount_point = os.path.join(scratch, "mnt")
+    try:
+        tree = options.tree
+        if options.loop_image:
+            make_loop_image(options.loop_image, options.image_size_mb, mount_point)
+        if not tree:
+            tree = os.path.join(mount_point if options.loop_image else scratch, "tree")
+            run([generator, tree, "--files", str(options.files), "--seed", str(options.seed)],
+                stdout=subprocess.DEVNULL)
+
+        dropper = CacheDropper(options.loop_image, mount_point)
+        caches = ["warm", "cold"] if options.cache == "both" else [options.cache]
+        results = []
+        for mode in modes:
+            for cache in caches:
+                walls = []
+                stats = None
+                if cache == "warm":
+                    run_mode(tool, tree, MODES[mode], options.jobs)  # Populate the cache
+                for _ in range(options.runs):
+                    if cache == "cold" and not dropper.drop():
+                        print(f"skipping cold runs: cannot drop the page cache (needs root, or use --loop-image)",
+                              file=sys.stderr)
+                        break
+                    wall, stats = run_mode(tool, tree, MODES[mode], options.jobs)
+                    walls.append(wall)
+                if walls:
+                    results.append(summarize(mode, cache, walls, stats))
+                elif cache == "cold":
+                    caches = ["warm"]  # Don't retry for the remaining modes
+
+        baseline = None
+        if options.compare:
+            with open(options.compare) as f:
+                baseline = json.load(f)
+        print_table(results, baseline)
+        if options.save:
+            with open(options.save, "w") as f:
+                json.dump({"tree": tree, "files": options.files, "jobs": options.jobs, "results": results}, f, indent=2)
+    finally:
+        if options.loop_image:
+            subprocess.run(["umount", mount_point])
+        shutil.rmtree(scratch, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,100 @@
+#include "synthetic.h"
+
+#include <cstdio>
+
+/**
+ * @return The next 64 random bits.
+ */
+uint64_t Random::next()
+{
+    uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @param bound Exclusive upper bound.
+ * @return A value in [0, bound), or 0 if bound is 0.
+ */
+uint64_t Random::below(uint64_t bound)
+{
+    return bound ? next() % bound : 0;
+}
+
+/**
+ * @return A value in [0, 1).
+ */
+double Random::unit()
+{
+    return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @param probability Probability of returning true.
+ * @return True with the given probability.
+ */
+bool Random::chance(double probability)
+{
+    return unit() < probability;
+}
+
+/**
+ * Picks people with a Zipf-like skew (a few people appear in most photos), as in real libraries.
+ * @param random The generator.
+ * @param people Number of distinct people.
+ * @return A person index.
+ */
+unsigned pickPerson(Random &random, unsigned people)
+{
+    // Squaring a uniform value concentrates picks on low indices
+    double u = random.unit();
+    return static_cast<unsigned>(u * u * people);
+}
+
+/**
+ * Returns the sidecar name Takeout uses for a media file. Takeout truncates sidecar names to 51 characters,
+ * so long media names get names like "PXL_20210512_101010123.jpg.supplemental-meta.json".
+ * @param mediaName The media file name.
+ * @param suppl Use the short '.suppl.json' form.
+ * @return The sidecar file name.
+ */
+std::string takeoutSidecarName(const std::string &mediaName, bool suppl)
+{
+    std::string stem = mediaName + (suppl ? ".suppl" : ".supplemental-metadata");
+    if (stem.size() > 46)
+        stem.resize(46);
+    return stem + ".json";
+}
+
+/**
+ * Builds sidecar JSON shaped like Takeout's, including the fields the tool ignores.
+ * @param photo The photo the sidecar describes.
+ * @param random Source for view counts and coordinates.
+ * @return The JSON text.
+ */
+std::string takeoutSidecarJSON(const SyntheticPhoto &photo, Random &random)
+{
+    char text[1024];
+    std::snprintf(text, sizeof(text),
+                  "{\n  \"title\": \"%s\",\n  \"description\": \"\",\n  \"imageViews\": \"%llu\",\n"
+                  "  \"creationTime\": {\n    \"timestamp\": \"%lld\",\n    \"formatted\": \"Jan 1, 2020, 12:00:00 AM UTC\"\n  },\n"
+                  "  \"photoTakenTime\": {\n    \"timestamp\": \"%lld\",\n    \"formatted\": \"Jan 1, 2020, 12:00:00 AM UTC\"\n  },\n"
+                  "  \"geoData\": {\n    \"latitude\": %.7f,\n    \"longitude\": %.7f,\n    \"altitude\": 0.0,\n"
+                  "    \"latitudeSpan\": 0.0,\n    \"longitudeSpan\": 0.0\n  },\n",
+                  photo.mediaName.c_str(), static_cast<unsigned long long>(random.below(50)),
+                  static_cast<long long>(photo.uploadTime), static_cast<long long>(photo.takenTime),
+                  static_cast<double>(random.below(180000000)) / 1e6 - 90,
+                  static_cast<double>(random.below(360000000)) / 1e6 - 180);
+    std::string json = text;
+    if (!photo.people.empty())
+    {
+        json += "  \"people\": [";
+        for (size_t i = 0; i < photo.people.size(); ++i)
+            json += std::string(i ? ", " : "") + "{\n    \"name\": \"" + photo.people[i] + "\"\n  }";
+        json += "],\n";
+    }
+    json += "  \"url\": \"https://photos.google.com/photo/AF1Qip\",\n"
+            "  \"googlePhotosOrigin\": {\n    \"mobileUpload\": {\n      \"deviceType\": \"IOS_PHONE\"\n    }\n  }\n}\n";
+    return json;
+}
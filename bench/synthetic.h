@@ -0,0 +1,42 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * splitmix64: small, fast and identical everywhere, unlike the std:: distributions, so a seed produces the
+ * same data with every standard library.
+ */
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+
+    uint64_t next();
+    uint64_t below(uint64_t bound);
+    double unit();
+    bool chance(double probability);
+
+private:
+    uint64_t state_;
+};
+
+/**
+ * Media file name and metadata of one synthetic photo.
+ */
+struct SyntheticPhoto
+{
+    std::string mediaName;
+    int64_t takenTime = 0;
+    int64_t uploadTime = 0;
+    std::vector<std::string> people;
+    bool live = false;
+};
+
+unsigned pickPerson(Random &random, unsigned people);
+std::string takeoutSidecarName(const std::string &mediaName, bool suppl);
+std::string takeoutSidecarJSON(const SyntheticPhoto &photo, Random &random);
+
+#endif
@@ -0,0 +1,167 @@
+// Runs a command under ptrace and counts the system calls made by all of its threads (Linux only).
+// Writes one JSON object to a file: {"calls": {"<name>": count, ...}, "total": n}.
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Returns the name of a system call the budget tracks, or "other".
+ * @param number The system call number.
+ * @return The name.
+ */
+static const char *syscallName(long number)
+{
+    static const std::map<long, const char *> names = {
+#ifdef SYS_stat
+        {SYS_stat, "stat"},
+#endif
+#ifdef SYS_lstat
+        {SYS_lstat, "lstat"},
+#endif
+#ifdef SYS_newfstatat
+        {SYS_newfstatat, "newfstatat"},
+#endif
+#ifdef SYS_statx
+        {SYS_statx, "statx"},
+#endif
+        {SYS_fstat, "fstat"},
+#ifdef SYS_open
+        {SYS_open, "open"},
+#endif
+        {SYS_openat, "openat"},
+        {SYS_close, "close"},
+        {SYS_read, "read"},
+        {SYS_pread64, "pread64"},
+        {SYS_write, "write"},
+        {SYS_pwrite64, "pwrite64"},
+        {SYS_lseek, "lseek"},
+        {SYS_getdents64, "getdents64"},
+        {SYS_utimensat, "utimensat"},
+        {SYS_setxattr, "setxattr"},
+        {SYS_futex, "futex"},
+        {SYS_mmap, "mmap"},
+        {SYS_munmap, "munmap"},
+        {SYS_brk, "brk"},
+    };
+    auto name = names.find(number);
+    return name == names.end() ? "other" : name->second;
+}
+
+/**
+ * Reads the system call number of a thread stopped at a system call.
+ */
+static long syscallNumber(pid_t tid)
+{
+    user_regs_struct regs;
+    if (ptrace(PTRACE_GETREGS, tid, nullptr, &regs) != 0)
+        return -1;
+#if defined(__x86_64__)
+    return static_cast<long>(regs.orig_rax);
+#elif defined(__aarch64__)
+    return static_cast<long>(regs.regs[8]);
+#else
+#error "syscall_count supports x86-64 and AArch64"
+#endif
+}
+
+/**
+ * Traces the command and prints the counts.
+ * @return The command's exit status, or 1 if it could not be traced.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: takeout_syscall_count <output.json> <command> [args...]" << std::endl;
+        return 1;
+    }
+    std::ofstream out(argv[1], std::ios::trunc);
+    if (!out.is_open())
+    {
+        std::cerr << "Failed to open " << argv[1] << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        raise(SIGSTOP);
+        execvp(argv[2], argv + 2);
+        std::perror(argv[2]);
+        _exit(127);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, child, nullptr,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+
+    // Entry and exit stops alternate per thread; count at entry only. Counting starts after exec, so the
+    // tracer's own fork and exec are not included.
+    std::set<pid_t> inSyscall;
+    std::map<std::string, unsigned long long> counts;
+    bool execDone = false;
+    int exitCode = 1;
+    for (;;)
+    {
+        pid_t tid = waitpid(-1, &status, __WALL);
+        if (tid < 0)
+            break;
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+        {
+            if (tid == child)
+                exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            inSyscall.erase(tid);
+            continue;
+        }
+
+        int signal = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+        {
+            if (inSyscall.erase(tid) == 0)
+            {
+                inSyscall.insert(tid);
+                if (execDone)
+                    ++counts[syscallName(syscallNumber(tid))];
+            }
+        }
+        else if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXEC << 8)))
+        {
+            execDone = true;
+            inSyscall.clear();
+        }
+        else if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_CLONE << 8)) || WSTOPSIG(status) == SIGSTOP)
+        {
+            // New threads start with a SIGSTOP that must not be delivered
+        }
+        else
+            signal = WSTOPSIG(status);
+        ptrace(PTRACE_SYSCALL, tid, nullptr, signal);
+    }
+
+    unsigned long long total = 0;
+    out << "{\"calls\":{";
+    const char *separator = "";
+    for (const auto &count : counts)
+    {
+        out << separator << "\"" << count.first << "\":" << count.second;
+        separator = ",";
+        total += count.second;
+    }
+    out << "},\"total\":" << total << "}" << std::endl;
+    return exitCode;
+}
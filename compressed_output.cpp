@@ -0,0 +1,378 @@
+#include "compressed_output.h"
+#include "error_log.h"
+#include "output_writer.h"
+#include "run_stats.h"
+#include "trace.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef TAKEOUT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TAKEOUT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+    // Blocks handed to the compressor; up to maxQueuedBlocks wait before writers block.
+    const size_t blockSize = 256 * 1024;
+    const size_t maxQueuedBlocks = 8;
+
+    /**
+     * @return True if text ends with suffix.
+     */
+    bool endsWith(const std::string &text, const char *suffix)
+    {
+        size_t length = std::strlen(suffix);
+        return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+    }
+}
+
+/**
+ * Turns blocks of output into the bytes written to the file.
+ */
+class OutputEncoder
+{
+public:
+    virtual ~OutputEncoder() = default;
+
+    /**
+     * @param data The next block.
+     * @param size Bytes in the block.
+     * @param finish True for the last call, which ends the stream (data may then be empty).
+     * @param out Receives the encoded bytes; it is cleared first.
+     * @return False on an encoder error.
+     */
+    virtual bool encode(const char *data, size_t size, bool finish, std::string &out) = 0;
+};
+
+namespace
+{
+    class PlainEncoder : public OutputEncoder
+    {
+    public:
+        bool encode(const char *data, size_t size, bool, std::string &out) override
+        {
+            out.assign(data, size);
+            return true;
+        }
+    };
+
+#ifdef TAKEOUT_HAVE_ZLIB
+    /**
+     * gzip (RFC 1952) through zlib's deflate.
+     */
+    class GzipEncoder : public OutputEncoder
+    {
+    public:
+        GzipEncoder()
+        {
+            std::memset(&stream_, 0, sizeof(stream_));
+            // Level 3 keeps most of the ratio of the default level 6 at about twice the speed
+            ok_ = deflateInit2(&stream_, 3, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+
+        ~GzipEncoder() override
+        {
+            if (ok_)
+                deflateEnd(&stream_);
+        }
+
+        bool encode(const char *data, size_t size, bool finish, std::string &out) override
+        {
+            out.clear();
+            if (!ok_)
+                return false;
+            stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+            stream_.avail_in = static_cast<uInt>(size);
+            for (;;)
+            {
+                size_t used = out.size();
+                out.resize(used + deflateBound(&stream_, stream_.avail_in) + 64);
+                stream_.next_out = reinterpret_cast<Bytef *>(&out[used]);
+                stream_.avail_out = static_cast<uInt>(out.size() - used);
+                int result = deflate(&stream_, finish ? Z_FINISH : Z_NO_FLUSH);
+                out.resize(out.size() - stream_.avail_out);
+                if (result == Z_STREAM_ERROR)
+                    return false;
+                if (finish ? result == Z_STREAM_END : stream_.avail_in == 0)
+                    return true;
+            }
+        }
+
+    private:
+        z_stream stream_;
+        bool ok_ = false;
+    };
+#endif
+
+#ifdef TAKEOUT_HAVE_ZSTD
+    /**
+     * Zstandard frames through the streaming API.
+     */
+    class ZstdEncoder : public OutputEncoder
+    {
+    public:
+        ZstdEncoder() : context_(ZSTD_createCCtx())
+        {
+            if (context_)
+                ZSTD_CCtx_setParameter(context_, ZSTD_c_compressionLevel, 3);
+        }
+
+        ~ZstdEncoder() override
+        {
+            ZSTD_freeCCtx(context_);
+        }
+
+        bool encode(const char *data, size_t size, bool finish, std::string &out) override
+        {
+            out.clear();
+            if (!context_)
+                return false;
+            ZSTD_inBuffer input = {data, size, 0};
+            for (;;)
+            {
+                size_t used = out.size();
+                out.resize(used + ZSTD_CStreamOutSize());
+                ZSTD_outBuffer output = {&out[used], out.size() - used, 0};
+                size_t remaining = ZSTD_compressStream2(context_, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+                out.resize(used + output.pos);
+                if (ZSTD_isError(remaining))
+                    return false;
+                if (finish ? remaining == 0 : input.pos == input.size)
+                    return true;
+            }
+        }
+
+    private:
+        ZSTD_CCtx *context_;
+    };
+#endif
+}
+
+/**
+ * Picks the codec for an output file from its extension: '.gz' for gzip, '.zst' for Zstandard.
+ * @param path The output file path.
+ * @return The codec.
+ */
+OutputCodec outputCodecFor(const std::string &path)
+{
+    if (endsWith(path, ".gz"))
+        return OutputCodec::Gzip;
+    if (endsWith(path, ".zst"))
+        return OutputCodec::Zstd;
+    return OutputCodec::None;
+}
+
+/**
+ * @param codec A codec.
+ * @return True if this build includes it.
+ */
+bool outputCodecAvailable(OutputCodec codec)
+{
+    switch (codec)
+    {
+    case OutputCodec::None:
+        return true;
+    case OutputCodec::Gzip:
+#ifdef TAKEOUT_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case OutputCodec::Zstd:
+#ifdef TAKEOUT_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+CompressedFileBuf::CompressedFileBuf() = default;
+
+CompressedFileBuf::~CompressedFileBuf()
+{
+    close();
+}
+
+/**
+ * Creates (or truncates) the file and starts the compressor thread.
+ * @param path The file.
+ * @param codec The compression; must be available in this build.
+ * @return False if the file cannot be opened or the codec is unavailable.
+ */
+bool CompressedFileBuf::open(const std::string &path, OutputCodec codec)
+{
+    if (!outputCodecAvailable(codec))
+        return false;
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open())
+        return false;
+
+    path_ = path;
+    switch (codec)
+    {
+#ifdef TAKEOUT_HAVE_ZLIB
+    case OutputCodec::Gzip:
+        encoder_.reset(new GzipEncoder());
+        break;
+#endif
+#ifdef TAKEOUT_HAVE_ZSTD
+    case OutputCodec::Zstd:
+        encoder_.reset(new ZstdEncoder());
+        break;
+#endif
+    default:
+        encoder_.reset(new PlainEncoder());
+        break;
+    }
+    closing_ = false;
+    failed_ = false;
+    block_.resize(blockSize);
+    setp(&block_[0], &block_[0] + block_.size());
+    thread_ = std::thread(&CompressedFileBuf::compressLoop, this);
+    return true;
+}
+
+/**
+ * Writes the remaining output, ends the compressed stream and closes the file.
+ * @return False if anything failed to compress or write (reported as ErrorCode::OutputWriteFailed).
+ */
+bool CompressedFileBuf::close()
+{
+    if (!thread_.joinable())
+        return true;
+    handOff();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    blockReady_.notify_one();
+    thread_.join();
+    setp(nullptr, nullptr);
+    file_.close();
+    if (!failed_ && file_.fail())
+    {
+        reportError(ErrorCode::OutputWriteFailed, errno, path_);
+        flushThreadOutput();
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+/**
+ * Called when the block is full: queues it and stores c in a fresh one.
+ */
+CompressedFileBuf::int_type CompressedFileBuf::overflow(int_type c)
+{
+    if (!thread_.joinable())
+        return traits_type::eof();
+    handOff();
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+/**
+ * Queues the partly filled block, so flushing the stream moves everything written so far to the compressor.
+ */
+int CompressedFileBuf::sync()
+{
+    if (thread_.joinable())
+        handOff();
+    return 0;
+}
+
+/**
+ * Queues the filled part of the current block and switches to a spare one. Waits only while
+ * maxQueuedBlocks are already queued.
+ */
+void CompressedFileBuf::handOff()
+{
+    size_t used = static_cast<size_t>(pptr() - pbase());
+    if (used == 0)
+        return;
+    block_.resize(used);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        blockTaken_.wait(lock, [this]
+                         { return queue_.size() < maxQueuedBlocks; });
+        queue_.push_back(std::move(block_));
+        if (!spare_.empty())
+        {
+            block_ = std::move(spare_.back());
+            spare_.pop_back();
+        }
+        else
+        {
+            block_ = std::string();
+        }
+    }
+    blockReady_.notify_one();
+    block_.resize(blockSize);
+    setp(&block_[0], &block_[0] + block_.size());
+}
+
+/**
+ * Compressor thread: encodes and writes queued blocks in order, then ends the stream once closing.
+ */
+void CompressedFileBuf::compressLoop()
+{
+    nameTraceThread("compressor");
+    std::string block;
+    bool haveBlock = false;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (haveBlock)
+                spare_.push_back(std::move(block));
+            blockReady_.wait(lock, [this]
+                             { return !queue_.empty() || closing_; });
+            if (queue_.empty())
+                break;
+            block = std::move(queue_.front());
+            queue_.pop_front();
+            haveBlock = true;
+        }
+        blockTaken_.notify_one();
+
+        PhaseTimer timer(Phase::Output);
+        if (!failed_ && !encoder_->encode(block.data(), block.size(), false, compressed_))
+        {
+            reportError(ErrorCode::OutputWriteFailed, 0, path_, "compression failed");
+            failed_ = true;
+        }
+        write(compressed_);
+    }
+
+    if (!failed_ && !encoder_->encode(nullptr, 0, true, compressed_))
+    {
+        reportError(ErrorCode::OutputWriteFailed, 0, path_, "compression failed");
+        failed_ = true;
+    }
+    write(compressed_);
+    file_.flush();
+    flushThreadOutput();
+}
+
+/**
+ * Writes encoded bytes unless an earlier step failed.
+ */
+void CompressedFileBuf::write(const std::string &data)
+{
+    if (failed_ || data.empty())
+        return;
+    if (!file_.write(data.data(), static_cast<std::streamsize>(data.size())))
+    {
+        reportError(ErrorCode::OutputWriteFailed, errno, path_);
+        failed_ = true;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef COMPRESSED_OUTPUT_H
+#define COMPRESSED_OUTPUT_H
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class OutputCodec
+{
+    None,
+    Gzip,
+    Zstd
+};
+
+OutputCodec outputCodecFor(const std::string &path);
+bool outputCodecAvailable(OutputCodec codec);
+
+class OutputEncoder;
+
+/**
+ * Stream buffer that writes to a file, optionally compressed, on a thread of its own. Writers only copy
+ * into a block; full blocks are queued to the compressor thread, so producing output never waits on
+ * compression unless the queue is full. One thread at a time may write to it.
+ */
+class CompressedFileBuf : public std::streambuf
+{
+public:
+    CompressedFileBuf();
+    ~CompressedFileBuf() override;
+
+    bool open(const std::string &path, OutputCodec codec);
+    bool close();
+    bool isOpen() const { return thread_.joinable(); }
+
+protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+private:
+    void handOff();
+    void compressLoop();
+    void write(const std::string &data);
+
+    std::string path_;
+    std::ofstream file_;
+    std::unique_ptr<OutputEncoder> encoder_;
+    std::string block_; // Put area
+    std::string compressed_;
+    std::deque<std::string> queue_;
+    std::vector<std::string> spare_;
+    std::mutex mutex_;
+    std::condition_variable blockReady_;
+    std::condition_variable blockTaken_;
+    bool closing_ = false;
+    bool failed_ = false; // Compressor thread only until joined
+    std::thread thread_;
+};
+
+#endif
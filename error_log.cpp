@@ -0,0 +1,186 @@
+#include "error_log.h"
+#include "format.h"
+#include "output_writer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+    /**
+     * Static description of one error class.
+     */
+    struct ErrorClass
+    {
+        const char *name;   // Stable identifier used in the log and the summary
+        const char *phase;  // Pipeline phase the error occurs in
+        const char *prefix; // Human-readable message before the quoted path
+        const char *suffix; // Message after the path when there is no detail
+    };
+
+    const ErrorClass errorClasses[] = {
+        {"scan-failed", "walk", "Error scanning ", ""},
+        {"sidecar-open-failed", "read", "Failed to open sidecar ", ""},
+        {"parse-failed", "parse", "Error parsing JSON ", ""},
+        {"missing-field", "parse", "Missing field in ", ""},
+        {"bad-value", "parse", "Bad value in ", ""},
+        {"primary-missing", "resolve", "Primary file ", " does not exist"},
+        {"target-open-failed", "apply", "Failed to open ", ""},
+        {"set-times-failed", "apply", "Failed to set modification time for ", ""},
+        {"set-creation-time-failed", "apply", "Failed to set creation time for ", ""},
+        {"get-tags-failed", "apply", "Failed to get tags for ", ""},
+        {"set-tags-failed", "apply", "Failed to set tags for ", ""},
+        {"metrics-write-failed", "output", "Failed to write metrics file ", ""},
+        {"output-write-failed", "output", "Failed to write output file ", ""},
+        {"spill-failed", "output", "Failed to write a sorted run in ", ""},
+        {"spill-read-failed", "output", "Failed to read sorted run ", ""},
+        {"media-read-failed", "read", "Failed to read media file ", ""},
+        {"media-write-failed", "apply", "Failed to update media file ", ""},
+        {"exif-not-in-place", "apply", "No 20-byte EXIF DateTimeOriginal to overwrite in ", ""},
+        {"exif-no-offset", "apply", "No EXIF OffsetTimeOriginal to write the local time in for ", ""},
+        {"movie-not-in-place", "apply", "No movie header times to overwrite in ", ""},
+    };
+    static_assert(sizeof(errorClasses) / sizeof(errorClasses[0]) == static_cast<size_t>(ErrorCode::Count),
+                  "errorClasses must list every ErrorCode");
+
+    std::atomic<size_t> errorCounts[static_cast<size_t>(ErrorCode::Count)];
+    std::atomic<bool> structuredLog(false);
+    std::function<void(const ErrorReport &)> errorHandler;
+}
+
+/**
+ * Computes a stable 64-bit id for a path (FNV-1a), so log records can be grouped by file without
+ * comparing strings and ids stay the same across runs over the same tree.
+ * @param path The path.
+ * @return The id.
+ */
+static uint64_t pathId(const std::string &path)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : path)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Records an error. The error is counted for the end-of-run summary and then passed to the handler set with
+ * setErrorHandler(), or else written as a JSON line to the error log (with setStructuredErrorLog(true)) or as
+ * a message line to the error stream. Both go through the thread's output buffer, so nothing is written or
+ * flushed synchronously.
+ * @param code The error class.
+ * @param osError errno (or GetLastError() on Windows), or 0 if not applicable.
+ * @param path The file or folder the error is about.
+ * @param detail Additional detail; defaults to the description of osError for classes without a fixed suffix.
+ */
+void reportError(ErrorCode code, int osError, const std::string &path, const std::string &detail)
+{
+    const ErrorClass &errorClass = errorClasses[static_cast<size_t>(code)];
+    errorCounts[static_cast<size_t>(code)].fetch_add(1, std::memory_order_relaxed);
+
+    std::string detailText = detail;
+    if (detailText.empty() && osError != 0 && errorClass.suffix[0] == '\0')
+    {
+#ifdef _WIN32
+        detailText = "error " + std::to_string(osError);
+#else
+        detailText = strerror(osError);
+#endif
+    }
+    std::ostringstream message;
+    message << errorClass.prefix << std::quoted(path);
+    if (!detailText.empty())
+        message << ": " << detailText;
+    else
+        message << errorClass.suffix;
+
+    if (errorHandler)
+    {
+        errorHandler({code, osError, path, message.str()});
+        return;
+    }
+    if (structuredLog.load(std::memory_order_relaxed))
+    {
+        char id[17];
+        std::snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(pathId(path)));
+        threadStream(OutputStream::ErrorLog)
+            << "{\"code\":\"" << errorClass.name << "\",\"phase\":\"" << errorClass.phase
+            << "\",\"errno\":" << osError << ",\"path_id\":\"" << id << "\",\"path\":" << escapeJSON(path)
+            << ",\"message\":" << escapeJSON(message.str()) << "}\n";
+        return;
+    }
+    threadErr() << message.str() << '\n';
+}
+
+/**
+ * Selects where reportError() writes: JSON lines to the error log instead of messages on stderr.
+ * @param enabled True when '--error-log' is given.
+ */
+void setStructuredErrorLog(bool enabled)
+{
+    structuredLog = enabled;
+}
+
+/**
+ * Routes reported errors to a callback instead of the error stream or log, for embedding the scanner.
+ * The handler is called on whichever thread reports the error, so it must be thread-safe. Set it before a
+ * run starts; an empty function restores the default output.
+ * @param handler The callback.
+ */
+void setErrorHandler(std::function<void(const ErrorReport &)> handler)
+{
+    errorHandler = std::move(handler);
+}
+
+/**
+ * @param code The error class.
+ * @return The stable identifier of the class (e.g. "parse-failed").
+ */
+const char *errorCodeName(ErrorCode code)
+{
+    return errorClasses[static_cast<size_t>(code)].name;
+}
+
+/**
+ * @param code The error class.
+ * @return Number of errors of that class reported so far.
+ */
+size_t errorCount(ErrorCode code)
+{
+    return errorCounts[static_cast<size_t>(code)].load(std::memory_order_relaxed);
+}
+
+/**
+ * @return Number of errors of all classes reported so far.
+ */
+size_t totalErrorCount()
+{
+    size_t total = 0;
+    for (size_t i = 0; i < static_cast<size_t>(ErrorCode::Count); ++i)
+        total += errorCounts[i].load(std::memory_order_relaxed);
+    return total;
+}
+
+/**
+ * Prints error counts grouped by class, if any errors were reported.
+ * @param out The stream to print to.
+ */
+void printErrorSummary(std::ostream &out)
+{
+    size_t total = totalErrorCount();
+    if (total == 0)
+        return;
+    out << total << (total == 1 ? " error" : " errors") << ":\n";
+    for (size_t i = 0; i < static_cast<size_t>(ErrorCode::Count); ++i)
+    {
+        size_t count = errorCounts[i].load(std::memory_order_relaxed);
+        if (count > 0)
+            out << "  " << errorClasses[i].name << " (" << errorClasses[i].phase << "): " << count << "\n";
+    }
+}
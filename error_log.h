@@ -0,0 +1,52 @@
+#ifndef ERROR_LOG_H
+#define ERROR_LOG_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+enum class ErrorCode
+{
+    ScanFailed,
+    SidecarOpenFailed,
+    ParseFailed,
+    MissingField,
+    BadValue,
+    PrimaryMissing,
+    TargetOpenFailed,
+    SetTimesFailed,
+    SetCreationTimeFailed,
+    GetTagsFailed,
+    SetTagsFailed,
+    MetricsWriteFailed,
+    OutputWriteFailed,
+    SpillFailed,
+    SpillReadFailed,
+    MediaReadFailed,
+    MediaWriteFailed,
+    ExifNotInPlace,
+    ExifNoOffset,
+    MovieNotInPlace,
+    Count
+};
+
+/**
+ * An error as passed to an error handler installed with setErrorHandler().
+ */
+struct ErrorReport
+{
+    ErrorCode code;
+    int osError;         // errno (or GetLastError() on Windows), or 0
+    std::string path;
+    std::string message; // The same text reportError() would print
+};
+
+void reportError(ErrorCode code, int osError, const std::string &path, const std::string &detail = std::string());
+void setStructuredErrorLog(bool enabled);
+void setErrorHandler(std::function<void(const ErrorReport &)> handler);
+const char *errorCodeName(ErrorCode code);
+size_t errorCount(ErrorCode code);
+size_t totalErrorCount();
+void printErrorSummary(std::ostream &out);
+
+#endif
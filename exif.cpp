@@ -0,0 +1,667 @@
+#include "exif.h"
+#include "format.h"
+#include "media_file.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Files are read from the start of the EXIF data in growing steps, so a typical photo costs one 4 KB
+    // read; nothing past maxWindowBytes is ever looked at.
+    const size_t initialWindowBytes = 4096;
+    const size_t maxWindowBytes = 256 * 1024;
+
+    // JPEG markers and ISO BMFF boxes to walk before giving up on a damaged or unusual file
+    const int maxSegments = 64;
+    const int maxBoxes = 64;
+
+    const uint16_t tagExifIFD = 0x8769;
+    const uint16_t tagDateTimeOriginal = 0x9003;
+    const uint16_t tagOffsetTimeOriginal = 0x9011;
+    const uint16_t typeASCII = 2;
+    const uint16_t typeLong = 4;
+    const uint32_t dateTimeBytes = 20; // "YYYY:MM:DD HH:MM:SS" and a NUL
+
+    // Time stamps more than this far apart (in seconds) are reported
+    const int64_t toleranceSeconds = 2;
+    const int64_t maxZoneOffsetSeconds = 14 * 3600;
+
+    uint16_t readBE16(const unsigned char *p)
+    {
+        return static_cast<uint16_t>(p[0] << 8 | p[1]);
+    }
+
+    uint32_t readBE32(const unsigned char *p)
+    {
+        return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+               static_cast<uint32_t>(p[2]) << 8 | p[3];
+    }
+
+    uint64_t readBE64(const unsigned char *p)
+    {
+        return static_cast<uint64_t>(readBE32(p)) << 32 | readBE32(p + 4);
+    }
+
+    /**
+     * Reads a big-endian unsigned field of 0, 4 or 8 bytes (the variable widths of 'iloc').
+     */
+    uint64_t readBEField(const unsigned char *p, unsigned width)
+    {
+        return width == 8 ? readBE64(p) : width == 4 ? readBE32(p) : 0;
+    }
+
+    /**
+     * The bytes of a file from a base offset on, read on demand into a per-thread buffer (so a thread has
+     * one window at a time).
+     */
+    class FileWindow
+    {
+    public:
+        FileWindow(MediaFile &file, uint64_t base) : file_(file), base_(base)
+        {
+            buffer_.clear();
+        }
+
+        /**
+         * Moves the base, keeping the bytes already read from there on.
+         */
+        void rebase(uint64_t base)
+        {
+            if (base >= base_ && base - base_ < buffer_.size())
+                buffer_.erase(0, static_cast<size_t>(base - base_));
+            else
+                buffer_.clear();
+            base_ = base;
+        }
+
+        /**
+         * @param offset Start of the range, relative to the base.
+         * @param size Bytes needed.
+         * @return The bytes, or null if the range is past the end of the file or the window limit.
+         */
+        const unsigned char *data(uint64_t offset, size_t size)
+        {
+            if (offset > maxWindowBytes || size > maxWindowBytes - offset)
+                return nullptr;
+            size_t end = static_cast<size_t>(offset) + size;
+            if (end > buffer_.size() && !grow(end))
+                return nullptr;
+            return reinterpret_cast<const unsigned char *>(buffer_.data()) + offset;
+        }
+
+        uint64_t base() const { return base_; }
+        bool failed() const { return failed_; }
+
+    private:
+        bool grow(size_t end)
+        {
+            size_t target = std::max(end, std::max(buffer_.size() * 2, initialWindowBytes));
+            target = std::min(target, maxWindowBytes);
+            if (!file_.readAt(base_ + buffer_.size(), target - buffer_.size(), chunk_))
+            {
+                failed_ = true;
+                return false;
+            }
+            buffer_ += chunk_;
+            return buffer_.size() >= end;
+        }
+
+        MediaFile &file_;
+        uint64_t base_;
+        bool failed_ = false;
+        static thread_local std::string buffer_;
+        static thread_local std::string chunk_;
+    };
+
+    thread_local std::string FileWindow::buffer_;
+    thread_local std::string FileWindow::chunk_;
+
+    /**
+     * Integer fields of a TIFF structure in its byte order.
+     */
+    struct TiffOrder
+    {
+        bool little;
+
+        uint16_t u16(const unsigned char *p) const
+        {
+            return little ? static_cast<uint16_t>(p[1] << 8 | p[0]) : readBE16(p);
+        }
+
+        uint32_t u32(const unsigned char *p) const
+        {
+            return little ? static_cast<uint32_t>(p[3]) << 24 | static_cast<uint32_t>(p[2]) << 16 |
+                                static_cast<uint32_t>(p[1]) << 8 | p[0]
+                          : readBE32(p);
+        }
+    };
+
+    /**
+     * An IFD entry: tag, type, count and the value or offset to it.
+     */
+    struct IfdEntry
+    {
+        uint16_t tag;
+        uint16_t type;
+        uint32_t count;
+        uint32_t valueOffset;  // Relative to the TIFF header; the entry's own field for values of up to 4 bytes
+    };
+
+    /**
+     * Looks up tags in one IFD.
+     * @param window The file bytes.
+     * @param order The TIFF byte order.
+     * @param tiffStart Window offset of the TIFF header.
+     * @param ifdOffset Offset of the IFD from the TIFF header.
+     * @param tags The tags to find.
+     * @param found Receives an entry per tag; tags that are absent get tag 0.
+     * @param tagCount Number of tags.
+     * @return False if the IFD is out of reach.
+     */
+    bool findIfdEntries(FileWindow &window, const TiffOrder &order, uint64_t tiffStart, uint32_t ifdOffset,
+                        const uint16_t *tags, IfdEntry *found, size_t tagCount)
+    {
+        for (size_t i = 0; i < tagCount; ++i)
+            found[i].tag = 0;
+        const unsigned char *header = window.data(tiffStart + ifdOffset, 2);
+        if (!header)
+            return false;
+        uint16_t count = order.u16(header);
+        const unsigned char *entries = window.data(tiffStart + ifdOffset + 2, static_cast<size_t>(count) * 12);
+        if (!entries)
+            return false;
+        for (uint16_t e = 0; e < count; ++e)
+        {
+            const unsigned char *entry = entries + static_cast<size_t>(e) * 12;
+            uint16_t tag = order.u16(entry);
+            for (size_t i = 0; i < tagCount; ++i)
+            {
+                if (tag != tags[i])
+                    continue;
+                found[i].tag = tag;
+                found[i].type = order.u16(entry + 2);
+                found[i].count = order.u32(entry + 4);
+                // Values of up to 4 bytes are stored in the entry itself
+                found[i].valueOffset = found[i].count <= 4 ? static_cast<uint32_t>(ifdOffset + 2 + e * 12 + 8)
+                                                           : order.u32(entry + 8);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Copies an ASCII value without its terminating NUL.
+     */
+    bool readASCII(FileWindow &window, uint64_t tiffStart, const IfdEntry &entry, std::string &value)
+    {
+        if (entry.tag == 0 || entry.type != typeASCII || entry.count == 0 || entry.count > 64)
+            return false;
+        const unsigned char *text = window.data(tiffStart + entry.valueOffset, entry.count);
+        if (!text)
+            return false;
+        value.assign(reinterpret_cast<const char *>(text), entry.count);
+        value.resize(std::strlen(value.c_str()));
+        return true;
+    }
+
+    /**
+     * Reads DateTimeOriginal and OffsetTimeOriginal from the TIFF structure of an EXIF block.
+     * @param window The file bytes.
+     * @param tiffStart Window offset of the TIFF header ("II*\0" or "MM\0*").
+     * @param dates Receives the values.
+     * @return ExifStatus::Found or ExifStatus::NoDate.
+     */
+    ExifStatus parseTiff(FileWindow &window, uint64_t tiffStart, ExifDates &dates)
+    {
+        const unsigned char *header = window.data(tiffStart, 8);
+        if (!header)
+            return ExifStatus::NoDate;
+        TiffOrder order{header[0] == 'I'};
+        if ((std::memcmp(header, "II", 2) != 0 && std::memcmp(header, "MM", 2) != 0) || order.u16(header + 2) != 42)
+            return ExifStatus::NoDate;
+
+        const uint16_t ifd0Tags[] = {tagExifIFD};
+        IfdEntry ifd0[1];
+        if (!findIfdEntries(window, order, tiffStart, order.u32(header + 4), ifd0Tags, ifd0, 1) ||
+            ifd0[0].tag == 0 || ifd0[0].type != typeLong)
+            return ExifStatus::NoDate;
+        const unsigned char *pointer = window.data(tiffStart + ifd0[0].valueOffset, 4);
+        if (!pointer)
+            return ExifStatus::NoDate;
+
+        const uint16_t exifTags[] = {tagDateTimeOriginal, tagOffsetTimeOriginal};
+        IfdEntry exif[2];
+        if (!findIfdEntries(window, order, tiffStart, order.u32(pointer), exifTags, exif, 2))
+            return ExifStatus::NoDate;
+        int offset;
+        if (!readASCII(window, tiffStart, exif[1], dates.offsetTimeOriginal) ||
+            !parseExifOffset(dates.offsetTimeOriginal, offset))
+            dates.offsetTimeOriginal.clear();
+        // Only a value of the standard size can be overwritten in place, even if it is blank
+        if (readASCII(window, tiffStart, exif[0], dates.dateTimeOriginal) && exif[0].count == dateTimeBytes)
+            dates.dateTimeOriginalPosition = window.base() + tiffStart + exif[0].valueOffset;
+        time_t seconds;
+        if (!parseExifDateTime(dates.dateTimeOriginal, seconds))
+        {
+            dates.dateTimeOriginal.clear();
+            return ExifStatus::NoDate;
+        }
+        return ExifStatus::Found;
+    }
+
+    /**
+     * Walks the JPEG markers up to the first scan, looking for the APP1 "Exif" segment.
+     */
+    ExifStatus readJpegExif(FileWindow &window, ExifDates &dates)
+    {
+        uint64_t pos = 2;
+        for (int segment = 0; segment < maxSegments; ++segment)
+        {
+            const unsigned char *marker = window.data(pos, 4);
+            if (!marker || marker[0] != 0xff)
+                return ExifStatus::NoDate;
+            if (marker[1] == 0xff)
+            {
+                ++pos; // Fill byte
+                continue;
+            }
+            if (marker[1] == 0xd9 || marker[1] == 0xda)
+                return ExifStatus::NoDate; // End of image, or start of the compressed data
+            if (marker[1] == 0x01 || (marker[1] >= 0xd0 && marker[1] <= 0xd7))
+            {
+                pos += 2; // No length field
+                continue;
+            }
+            uint16_t length = readBE16(marker + 2);
+            if (marker[1] == 0xe1 && length >= 16)
+            {
+                const unsigned char *name = window.data(pos + 4, 6);
+                if (name && std::memcmp(name, "Exif\0\0", 6) == 0)
+                    return parseTiff(window, pos + 10, dates);
+            }
+            pos += 2 + static_cast<uint64_t>(length);
+        }
+        return ExifStatus::NoDate;
+    }
+
+    /**
+     * An ISO BMFF box found while walking a list of sibling boxes.
+     */
+    struct Box
+    {
+        char type[4];
+        uint64_t start;   // Window offset of the payload
+        uint64_t size;    // Payload bytes
+    };
+
+    /**
+     * Reads a box header, including the 64-bit form.
+     * @param end Window offset where the enclosing box ends; a size of 0 extends the box to it.
+     */
+    bool readBox(FileWindow &window, uint64_t pos, uint64_t end, Box &box)
+    {
+        const unsigned char *header = window.data(pos, 8);
+        if (!header || end - pos < 8)
+            return false;
+        uint64_t size = readBE32(header);
+        std::memcpy(box.type, header + 4, 4);
+        uint64_t headerSize = 8;
+        if (size == 1)
+        {
+            const unsigned char *large = window.data(pos + 8, 8);
+            if (!large)
+                return false;
+            size = readBE64(large);
+            headerSize = 16;
+        }
+        else if (size == 0)
+        {
+            size = end - pos;
+        }
+        if (size < headerSize || size > end - pos)
+            return false;
+        box.start = pos + headerSize;
+        box.size = size - headerSize;
+        return true;
+    }
+
+    /**
+     * Finds the first child box of a type.
+     */
+    bool findBox(FileWindow &window, uint64_t pos, uint64_t end, const char *type, Box &box)
+    {
+        for (int i = 0; i < maxBoxes && pos < end; ++i)
+        {
+            if (!readBox(window, pos, end, box))
+                return false;
+            if (std::memcmp(box.type, type, 4) == 0)
+                return true;
+            pos = box.start + box.size;
+        }
+        return false;
+    }
+
+    /**
+     * Finds the item ID of the "Exif" item in an 'iinf' box.
+     */
+    bool findExifItem(FileWindow &window, const Box &iinf, uint32_t &itemID)
+    {
+        const unsigned char *header = window.data(iinf.start, 6);
+        if (!header)
+            return false;
+        uint64_t pos = iinf.start + (header[0] == 0 ? 6 : 8);
+        uint64_t end = iinf.start + iinf.size;
+        Box infe;
+        for (int i = 0; i < maxBoxes && pos < end; ++i)
+        {
+            if (!readBox(window, pos, end, infe))
+                return false;
+            pos = infe.start + infe.size;
+            const unsigned char *entry = window.data(infe.start, 14);
+            if (std::memcmp(infe.type, "infe", 4) != 0 || !entry || entry[0] < 2)
+                continue;
+            // Version 2 has a 16-bit item ID, version 3 a 32-bit one; then protection index and item type
+            bool wide = entry[0] >= 3;
+            const unsigned char *type = entry + (wide ? 10 : 8);
+            if (std::memcmp(type, "Exif", 4) == 0)
+            {
+                itemID = wide ? readBE32(entry + 4) : readBE16(entry + 4);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Finds the file range of an item in an 'iloc' box. Only items stored in the file itself, in a single
+     * extent, are supported, which is how cameras write the EXIF item.
+     */
+    bool findItemLocation(FileWindow &window, const Box &iloc, uint32_t itemID, uint64_t &offset, uint64_t &length)
+    {
+        const unsigned char *header = window.data(iloc.start, 8);
+        if (!header)
+            return false;
+        unsigned version = header[0];
+        unsigned offsetSize = header[4] >> 4;
+        unsigned lengthSize = header[4] & 0x0f;
+        unsigned baseOffsetSize = header[5] >> 4;
+        unsigned indexSize = version >= 1 ? header[5] & 0x0f : 0;
+        uint64_t pos = iloc.start + 6;
+        const unsigned char *countField = window.data(pos, version < 2 ? 2 : 4);
+        if (!countField)
+            return false;
+        uint32_t itemCount = version < 2 ? readBE16(countField) : readBE32(countField);
+        pos += version < 2 ? 2 : 4;
+
+        for (uint32_t item = 0; item < itemCount && pos < iloc.start + iloc.size; ++item)
+        {
+            size_t fixed = (version < 2 ? 2 : 4) + (version >= 1 ? 2 : 0) + 2 + baseOffsetSize + 2;
+            const unsigned char *p = window.data(pos, fixed);
+            if (!p)
+                return false;
+            uint32_t id = version < 2 ? readBE16(p) : readBE32(p);
+            p += version < 2 ? 2 : 4;
+            unsigned constructionMethod = version >= 1 ? readBE16(p) & 0x0f : 0;
+            p += version >= 1 ? 2 : 0;
+            p += 2; // Data reference index
+            uint64_t baseOffset = readBEField(p, baseOffsetSize);
+            p += baseOffsetSize;
+            uint16_t extentCount = readBE16(p);
+            pos += fixed;
+
+            size_t extentSize = indexSize + offsetSize + lengthSize;
+            const unsigned char *extents = window.data(pos, extentSize * extentCount);
+            if (!extents)
+                return false;
+            if (id == itemID)
+            {
+                if (constructionMethod != 0 || extentCount != 1)
+                    return false;
+                offset = baseOffset + readBEField(extents + indexSize, offsetSize);
+                length = readBEField(extents + indexSize + offsetSize, lengthSize);
+                return true;
+            }
+            pos += extentSize * extentCount;
+        }
+        return false;
+    }
+
+    /**
+     * Locates the EXIF item through the 'meta' box of a HEIF file and reads it.
+     * @param window The file bytes from the start of the file; rebased to the EXIF item.
+     */
+    ExifStatus readHeifExif(FileWindow &window, uint64_t fileSize, ExifDates &dates)
+    {
+        Box meta, iinf, iloc;
+        uint32_t itemID;
+        uint64_t exifOffset = 0;
+        uint64_t exifLength = 0;
+        // 'meta' is a full box: its children follow a version and flags word
+        if (!findBox(window, 0, fileSize, "meta", meta) ||
+            !findBox(window, meta.start + 4, meta.start + meta.size, "iinf", iinf) ||
+            !findBox(window, meta.start + 4, meta.start + meta.size, "iloc", iloc) ||
+            !findExifItem(window, iinf, itemID) ||
+            !findItemLocation(window, iloc, itemID, exifOffset, exifLength) ||
+            exifLength < 12)
+            return ExifStatus::NoDate;
+
+        // The item starts with the offset of the TIFF header from the end of that field
+        window.rebase(exifOffset);
+        const unsigned char *prefix = window.data(0, 4);
+        if (!prefix)
+            return ExifStatus::NoDate;
+        return parseTiff(window, 4 + static_cast<uint64_t>(readBE32(prefix)), dates);
+    }
+
+    /**
+     * @return True if the characters of text match pattern, where 'D' stands for a digit.
+     */
+    bool matchesPattern(const std::string &text, const char *pattern)
+    {
+        size_t length = std::strlen(pattern);
+        if (text.size() != length)
+            return false;
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (pattern[i] == 'D' ? !std::isdigit(static_cast<unsigned char>(text[i])) : text[i] != pattern[i])
+                return false;
+        }
+        return true;
+    }
+
+    int digits(const std::string &text, size_t pos, size_t count)
+    {
+        int value = 0;
+        for (size_t i = 0; i < count; ++i)
+            value = value * 10 + (text[pos + i] - '0');
+        return value;
+    }
+
+    /**
+     * Days since 1970-01-01 of a proleptic Gregorian date.
+     */
+    int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+    {
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+        unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+    }
+}
+
+/**
+ * @param path A media file.
+ * @return True if its extension is one readExifDates() handles: .jpg, .jpeg, .heic or .heif, in any case.
+ */
+bool isExifImageName(const fs::path &path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".heic" || extension == ".heif";
+}
+
+/**
+ * Reads the EXIF capture time of an open JPEG or HEIC/HEIF photo (see the overload taking a path).
+ * @param file The photo.
+ * @param dates Receives the capture time and the position of its value.
+ * @return Whether a date was found.
+ */
+static ExifStatus readExifDates(MediaFile &file, ExifDates &dates)
+{
+    FileWindow window(file, 0);
+    const unsigned char *magic = window.data(0, 12);
+    if (!magic)
+        return window.failed() ? ExifStatus::Unreadable : ExifStatus::Unsupported;
+    ExifStatus status;
+    if (magic[0] == 0xff && magic[1] == 0xd8)
+        status = readJpegExif(window, dates);
+    else if (std::memcmp(magic + 4, "ftyp", 4) == 0)
+        status = readHeifExif(window, file.size(), dates);
+    else
+        return ExifStatus::Unsupported;
+    return window.failed() ? ExifStatus::Unreadable : status;
+}
+
+/**
+ * Reads the EXIF capture time of a JPEG or HEIC/HEIF photo. Only the bytes on the way to the EXIF date are
+ * read, a few KB from the start of the file (or of the EXIF item in HEIF), in positional reads that grow
+ * a per-thread buffer; the image data is never touched.
+ * @param path The photo.
+ * @param dates Receives the capture time and the position of its value.
+ * @return Whether a date was found; ExifStatus::Unreadable leaves lastMediaFileError() set.
+ */
+ExifStatus readExifDates(const fs::path &path, ExifDates &dates)
+{
+    dates = ExifDates();
+    MediaFile file;
+    if (!file.open(path))
+        return ExifStatus::Unreadable;
+    return readExifDates(file, dates);
+}
+
+/**
+ * Parses an EXIF date and time.
+ * @param text "YYYY:MM:DD HH:MM:SS".
+ * @param seconds Receives the time as seconds since the epoch, as if it were UTC.
+ * @return False if the text is not a valid date and time (cameras write blanks or zeros when unset).
+ */
+bool parseExifDateTime(const std::string &text, time_t &seconds)
+{
+    if (!matchesPattern(text, "DDDD:DD:DD DD:DD:DD"))
+        return false;
+    int year = digits(text, 0, 4);
+    unsigned month = static_cast<unsigned>(digits(text, 5, 2));
+    unsigned day = static_cast<unsigned>(digits(text, 8, 2));
+    int hour = digits(text, 11, 2);
+    int minute = digits(text, 14, 2);
+    int second = digits(text, 17, 2);
+    if (year == 0 || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+        return false;
+    seconds = static_cast<time_t>(daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second);
+    return true;
+}
+
+/**
+ * Parses an EXIF UTC offset.
+ * @param text "+HH:MM" or "-HH:MM".
+ * @param seconds Receives the offset east of UTC in seconds.
+ * @return False if the text is not an offset.
+ */
+bool parseExifOffset(const std::string &text, int &seconds)
+{
+    if (text.size() != 6 || (text[0] != '+' && text[0] != '-') || !matchesPattern(text.substr(1), "DD:DD"))
+        return false;
+    int hours = digits(text, 1, 2);
+    int minutes = digits(text, 4, 2);
+    if (hours > 14 || minutes > 59)
+        return false;
+    seconds = (text[0] == '-' ? -1 : 1) * (hours * 3600 + minutes * 60);
+    return true;
+}
+
+/**
+ * Compares an EXIF capture time with a sidecar's photoTakenTime (UTC). With OffsetTimeOriginal both are
+ * instants and must agree; without it the EXIF time is local, and only a difference that is no UTC
+ * offset at all (more than 14 hours, or not whole quarter hours) is a mismatch.
+ * @param dateTime ExifDates::dateTimeOriginal.
+ * @param offsetTime ExifDates::offsetTimeOriginal, or empty.
+ * @param photoTakenTime The sidecar time.
+ * @param difference Receives EXIF minus sidecar time in seconds, taking the EXIF time as UTC when it has no offset.
+ * @return The kind of mismatch.
+ */
+ExifMismatch compareExifTime(const std::string &dateTime, const std::string &offsetTime, time_t photoTakenTime,
+                             int64_t &difference)
+{
+    time_t local;
+    difference = 0;
+    if (!parseExifDateTime(dateTime, local))
+        return ExifMismatch::None;
+    int offset = 0;
+    bool hasOffset = parseExifOffset(offsetTime, offset);
+    difference = static_cast<int64_t>(local) - offset - static_cast<int64_t>(photoTakenTime);
+
+    int64_t magnitude = difference < 0 ? -difference : difference;
+    int64_t quarterHours = (magnitude + 450) / 900 * 900;
+    bool wholeQuarterHours = magnitude - quarterHours <= toleranceSeconds && quarterHours - magnitude <= toleranceSeconds;
+    if (hasOffset && magnitude <= toleranceSeconds)
+        return ExifMismatch::None;
+    if (wholeQuarterHours && magnitude <= maxZoneOffsetSeconds + toleranceSeconds)
+        return hasOffset ? ExifMismatch::TimeZone : ExifMismatch::None;
+    return ExifMismatch::Clock;
+}
+
+/**
+ * Overwrites the EXIF DateTimeOriginal of a JPEG or HEIC/HEIF photo with the sidecar time, in place: one
+ * positional write of the 20-byte value and nothing else, so the image is neither re-encoded nor rewritten.
+ * DateTimeOriginal is a local wall-clock time, so the time is written in the photo's OffsetTimeOriginal zone;
+ * photos without one are left alone (ExifWriteStatus::NoOffset) rather than guessing the zone. Photos whose
+ * EXIF time already agrees with the sidecar (see compareExifTime()) are left alone too.
+ * @param path The photo.
+ * @param photoTakenTime The sidecar time.
+ * @param keepFileTimes Set the access and modification times back after writing.
+ * @return What was done; ExifWriteStatus::Failed leaves lastMediaFileError() set.
+ */
+ExifWriteStatus writeExifDateTime(const fs::path &path, time_t photoTakenTime, bool keepFileTimes)
+{
+    // Compare on a read-only handle, so a read-only photo that already holds the time is Unchanged
+    MediaFile file;
+    if (!file.open(path))
+        return ExifWriteStatus::Failed;
+    ExifDates dates;
+    ExifStatus status = readExifDates(file, dates);
+    if (status == ExifStatus::Unreadable)
+        return ExifWriteStatus::Failed;
+    int64_t difference;
+    if (status == ExifStatus::Found &&
+        compareExifTime(dates.dateTimeOriginal, dates.offsetTimeOriginal, photoTakenTime, difference) == ExifMismatch::None)
+        return ExifWriteStatus::Unchanged;
+    if (dates.dateTimeOriginalPosition == 0)
+        return ExifWriteStatus::NotInPlace;
+    int offset = 0;
+    if (!parseExifOffset(dates.offsetTimeOriginal, offset))
+        return ExifWriteStatus::NoOffset;
+
+    // formatTime() gives "YYYY-MM-DD HH:MM:SS"; EXIF separates the date with colons
+    std::string value = formatTime(photoTakenTime + offset);
+    if (value.size() != dateTimeBytes - 1)
+        return ExifWriteStatus::NotInPlace;
+    value[4] = ':';
+    value[7] = ':';
+    // writeAt() refuses ranges past the end, should the photo have shrunk since it was read
+    if (!file.open(path, true))
+        return ExifWriteStatus::Failed;
+    if (!file.writeAt(dates.dateTimeOriginalPosition, value.c_str(), dateTimeBytes))
+        return ExifWriteStatus::Failed;
+    if (keepFileTimes && !file.restoreTimes())
+        return ExifWriteStatus::Failed;
+    return ExifWriteStatus::Written;
+}
@@ -0,0 +1,55 @@
+#ifndef EXIF_H
+#define EXIF_H
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <string>
+
+/**
+ * Capture time recorded by the camera in a photo's EXIF metadata.
+ */
+struct ExifDates
+{
+    std::string dateTimeOriginal;          // DateTimeOriginal, "YYYY:MM:DD HH:MM:SS" in the camera's local time
+    std::string offsetTimeOriginal;        // OffsetTimeOriginal, "+HH:MM", or empty if not recorded
+    uint64_t dateTimeOriginalPosition = 0; // File offset of the 20-byte DateTimeOriginal value, or 0 if there is
+                                           // none of that size (it is set even if the value is blank)
+};
+
+enum class ExifStatus
+{
+    Found,       // DateTimeOriginal was read
+    NoDate,      // A supported file without a usable DateTimeOriginal
+    Unsupported, // Neither JPEG nor HEIC/HEIF
+    Unreadable   // Could not be opened or read; lastMediaFileError() says why
+};
+
+/**
+ * How an EXIF capture time relates to a sidecar's photoTakenTime.
+ */
+enum class ExifMismatch
+{
+    None,     // The same instant, or a plain local time consistent with some UTC offset
+    TimeZone, // Off by a whole number of quarter hours: one side applied the wrong zone
+    Clock     // Off by anything else
+};
+
+enum class ExifWriteStatus
+{
+    Written,    // DateTimeOriginal was overwritten
+    Unchanged,  // DateTimeOriginal already agreed with the sidecar
+    NotInPlace, // No 20-byte DateTimeOriginal: adding one would change the EXIF structure
+    NoOffset,   // No OffsetTimeOriginal, so the local time to write is unknown
+    Failed      // Could not be opened, read or written; lastMediaFileError() says why
+};
+
+bool isExifImageName(const std::filesystem::path &path);
+ExifStatus readExifDates(const std::filesystem::path &path, ExifDates &dates);
+bool parseExifDateTime(const std::string &text, time_t &seconds);
+bool parseExifOffset(const std::string &text, int &seconds);
+ExifMismatch compareExifTime(const std::string &dateTime, const std::string &offsetTime, time_t photoTakenTime,
+                             int64_t &difference);
+ExifWriteStatus writeExifDateTime(const std::filesystem::path &path, time_t photoTakenTime, bool keepFileTimes);
+
+#endif
@@ -0,0 +1,375 @@
+#include "external_sort.h"
+#include "error_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <queue>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * Approximates the heap and object footprint of a buffered record.
+ * @param record The record.
+ * @return Estimated bytes of memory used.
+ */
+static size_t recordFootprint(const std::string &record)
+{
+    return sizeof(std::string) + (record.capacity() > 15 ? record.capacity() + 1 : 0);
+}
+
+/**
+ * Reports a run file that could not be created or written in the temporary directory.
+ * @param detail What happens next.
+ */
+void reportSpillFailed(const std::string &detail)
+{
+    std::error_code ec;
+    fs::path dir = fs::temp_directory_path(ec);
+    reportError(ErrorCode::SpillFailed, 0, ec ? std::string("$TMPDIR") : dir.string(),
+                ec ? ec.message() + "; " + detail : detail);
+}
+
+/**
+ * Creates a new, empty run file in the temporary directory.
+ * @param path Receives the path of the created file.
+ * @return True on success.
+ */
+static bool createRunFile(fs::path &path)
+{
+    std::error_code ec;
+    fs::path dir = fs::temp_directory_path(ec);
+    if (ec)
+        return false;
+#ifdef _WIN32
+    static std::atomic<unsigned> counter(0);
+    path = dir / ("takeout-run-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(counter++) + ".tmp");
+    return std::ofstream(path, std::ios::binary).good();
+#else
+    std::string pattern = (dir / "takeout-run-XXXXXX").string();
+    int fd = mkstemp(pattern.data());
+    if (fd == -1)
+        return false;
+    close(fd);
+    path = pattern;
+    return true;
+#endif
+}
+
+/**
+ * Appends a length-prefixed record to a run file.
+ * @param out The run file stream.
+ * @param record The record to write.
+ */
+static void writeRecord(std::ofstream &out, const std::string &record)
+{
+    uint32_t length = static_cast<uint32_t>(record.size());
+    out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    out.write(record.data(), length);
+}
+
+/**
+ * @param memoryBudget Bytes of buffered records to hold before spilling a sorted run to disk.
+ * @param unique If true, duplicate records are dropped (the sorter behaves like a std::set).
+ */
+ExternalSorter::ExternalSorter(size_t memoryBudget, bool unique)
+    : memoryBudget_(memoryBudget), spillThreshold_(memoryBudget), unique_(unique)
+{
+}
+
+/**
+ * Removes all run files.
+ */
+ExternalSorter::~ExternalSorter()
+{
+    std::error_code ec;
+    for (const auto &run : runs_)
+        fs::remove(run, ec);
+}
+
+/**
+ * Adds a record, spilling the buffer to a run file if the memory budget is exceeded.
+ * If a spill fails, the sorter keeps going in memory and doubles the threshold each time it is crossed, so
+ * the buffer is not sorted again on every record.
+ * @param record The record to add.
+ */
+void ExternalSorter::add(std::string record)
+{
+    bufferedBytes_ += recordFootprint(record);
+    buffer_.push_back(std::move(record));
+    if (bufferedBytes_ <= spillThreshold_)
+        return;
+
+    if (unique_)
+    {
+        // Sets usually contain many repeats (the same people on thousands of photos), so deduplicating
+        // in place often frees enough memory to keep going without touching the disk.
+        compact();
+        if (bufferedBytes_ <= spillThreshold_ / 2)
+            return;
+    }
+    if (spillFailed_ || !spill())
+    {
+        if (!spillFailed_)
+            reportSpillFailed("continuing in memory");
+        spillFailed_ = true;
+        size_t threshold = std::max(spillThreshold_, bufferedBytes_);
+        spillThreshold_ = threshold > SIZE_MAX / 2 ? SIZE_MAX : threshold * 2;
+    }
+}
+
+/**
+ * Writes records that the caller has already sorted straight to a new run file, bypassing the buffer.
+ * Lets callers with their own compact in-memory representation spill without building strings first.
+ * @param next Called repeatedly to fetch the next record in ascending order; returns false when done.
+ * @return True on success.
+ */
+bool ExternalSorter::addSortedRun(const std::function<bool(std::string &)> &next)
+{
+    fs::path path;
+    if (!createRunFile(path))
+        return false;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::string record;
+    while (next(record))
+        writeRecord(out, record);
+    out.close();
+    if (!out)
+    {
+        std::error_code ec;
+        fs::remove(path, ec);
+        return false;
+    }
+    runs_.push_back(path);
+    return true;
+}
+
+/**
+ * Sorts the buffer and, for unique sorters, removes duplicates.
+ */
+void ExternalSorter::compact()
+{
+    std::sort(buffer_.begin(), buffer_.end());
+    if (unique_)
+        buffer_.erase(std::unique(buffer_.begin(), buffer_.end()), buffer_.end());
+    bufferedBytes_ = 0;
+    for (const auto &record : buffer_)
+        bufferedBytes_ += recordFootprint(record);
+}
+
+/**
+ * Writes the sorted buffer to a new run file and clears it.
+ * @return True on success; on failure the buffer is kept.
+ */
+bool ExternalSorter::spill()
+{
+    compact();
+    fs::path path;
+    if (!createRunFile(path))
+        return false;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    for (const auto &record : buffer_)
+        writeRecord(out, record);
+    out.close();
+    if (!out)
+    {
+        std::error_code ec;
+        fs::remove(path, ec);
+        return false;
+    }
+
+    runs_.push_back(path);
+    std::vector<std::string>().swap(buffer_);
+    bufferedBytes_ = 0;
+    return true;
+}
+
+// Upper bound on run files merged at once, to stay well below the open file limit.
+static const size_t maxMergeFanIn = 64;
+
+namespace
+{
+    /**
+     * Sequential reader over one sorted run file.
+     */
+    struct RunReader
+    {
+        std::ifstream in;
+        std::string current;
+
+        explicit RunReader(const fs::path &path) : buffer(new char[bufferSize])
+        {
+            in.rdbuf()->pubsetbuf(buffer.get(), bufferSize);
+            in.open(path, std::ios::binary);
+        }
+
+        bool next()
+        {
+            uint32_t length;
+            if (!in.read(reinterpret_cast<char *>(&length), sizeof(length)))
+                return false;
+            current.resize(length);
+            return static_cast<bool>(in.read(&current[0], length));
+        }
+
+    private:
+        static const size_t bufferSize = 1 << 16;
+        std::unique_ptr<char[]> buffer;
+    };
+}
+
+/**
+ * Merges sorted run files and, optionally, a sorted in-memory buffer.
+ * @param runs The run files to merge.
+ * @param buffer Sorted records to merge in (may be empty).
+ * @param unique If true, equal records are visited once.
+ * @param visit Called for each record in ascending order.
+ * @return True on success, false if a run file could not be opened.
+ */
+static bool mergeRuns(const std::vector<fs::path> &runs, const std::vector<std::string> &buffer, bool unique,
+                      const std::function<void(const std::string &)> &visit)
+{
+    // Sources 0..runs-1 are run files; source runs.size() is the in-memory buffer.
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (const auto &run : runs)
+    {
+        readers.emplace_back(new RunReader(run));
+        if (!readers.back()->in)
+        {
+            reportError(ErrorCode::SpillReadFailed, 0, run.string());
+            return false;
+        }
+    }
+    size_t bufferPos = 0;
+    auto head = [&](size_t source) -> const std::string &
+    { return source < readers.size() ? readers[source]->current : buffer[bufferPos]; };
+    auto advance = [&](size_t source) -> bool
+    { return source < readers.size() ? readers[source]->next() : ++bufferPos < buffer.size(); };
+
+    auto greater = [&](size_t a, size_t b)
+    { return head(b) < head(a); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t source = 0; source < readers.size(); ++source)
+    {
+        if (readers[source]->next())
+            heap.push(source);
+    }
+    if (!buffer.empty())
+        heap.push(readers.size());
+
+    std::string last;
+    bool haveLast = false;
+    while (!heap.empty())
+    {
+        size_t source = heap.top();
+        heap.pop();
+        const std::string &record = head(source);
+        if (!unique || !haveLast || record != last)
+        {
+            visit(record);
+            if (unique)
+            {
+                last = record;
+                haveLast = true;
+            }
+        }
+        if (advance(source))
+            heap.push(source);
+    }
+    return true;
+}
+
+/**
+ * Visits all records in ascending byte order, merging the run files with the in-memory buffer.
+ * With many runs, groups of runs are first merged into larger runs so only a bounded number of files is
+ * open at once.
+ * @param visit Called once per record (once per distinct record for unique sorters).
+ * @return True on success, false if a run file could not be read or written.
+ */
+bool ExternalSorter::forEach(const std::function<void(const std::string &)> &visit)
+{
+    compact();
+    while (runs_.size() > maxMergeFanIn)
+    {
+        std::vector<fs::path> group(runs_.begin(), runs_.begin() + maxMergeFanIn);
+        fs::path merged;
+        if (!createRunFile(merged))
+        {
+            reportSpillFailed("cannot merge the runs");
+            return false;
+        }
+        std::ofstream out(merged, std::ios::binary | std::ios::trunc);
+        bool ok = mergeRuns(group, {}, unique_, [&out](const std::string &record)
+                            { writeRecord(out, record); });
+        out.close();
+        if (!ok || !out)
+        {
+            if (ok)
+                reportSpillFailed("cannot merge the runs");
+            std::error_code ec;
+            fs::remove(merged, ec);
+            return false;
+        }
+        std::error_code ec;
+        for (const auto &run : group)
+            fs::remove(run, ec);
+        runs_.erase(runs_.begin(), runs_.begin() + maxMergeFanIn);
+        runs_.push_back(merged);
+    }
+    return mergeRuns(runs_, buffer_, unique_, visit);
+}
+
+/**
+ * Parses a byte size such as "512M", "2G", "64K" or "1048576".
+ * @param text The size text; suffixes K, M, G (powers of 1024) are case-insensitive.
+ * @return The size in bytes, or 0 if the text is not a valid size or does not fit in a size_t.
+ */
+size_t parseByteSize(const std::string &text)
+{
+    char *end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || !std::isfinite(value) || value <= 0)
+        return 0;
+    std::string suffix(end);
+    if (!suffix.empty() && (suffix.back() == 'B' || suffix.back() == 'b'))
+        suffix.pop_back();
+    if (suffix.size() > 1)
+        return 0;
+    double scale = 1;
+    switch (suffix.empty() ? '\0' : suffix[0])
+    {
+    case '\0':
+        break;
+    case 'k':
+    case 'K':
+        scale = 1024.0;
+        break;
+    case 'm':
+    case 'M':
+        scale = 1024.0 * 1024;
+        break;
+    case 'g':
+    case 'G':
+        scale = 1024.0 * 1024 * 1024;
+        break;
+    default:
+        return 0;
+    }
+    // 2^64 (or 2^32) is exactly representable, unlike SIZE_MAX, so the comparison is exact
+    if (value >= std::ldexp(1.0, std::numeric_limits<size_t>::digits) / scale)
+        return 0;
+    return static_cast<size_t>(value * scale);
+}
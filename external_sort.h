@@ -0,0 +1,45 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Sorts byte strings with bounded memory.
+ * Records are buffered in memory; once the buffer exceeds the memory budget it is sorted and written to a
+ * run file in the temporary directory. forEach() k-way merges the runs with the remaining buffer.
+ */
+class ExternalSorter
+{
+public:
+    ExternalSorter(size_t memoryBudget, bool unique);
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter &) = delete;
+    ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+    void add(std::string record);
+    bool addSortedRun(const std::function<bool(std::string &)> &next);
+    bool forEach(const std::function<void(const std::string &)> &visit);
+    size_t runCount() const { return runs_.size(); }
+
+private:
+    void compact();
+    bool spill();
+
+    size_t memoryBudget_;
+    size_t spillThreshold_; // memoryBudget_, raised after a failed spill
+    bool unique_;
+    bool spillFailed_ = false;
+    size_t bufferedBytes_ = 0;
+    std::vector<std::string> buffer_;
+    std::vector<std::filesystem::path> runs_;
+};
+
+size_t parseByteSize(const std::string &text);
+void reportSpillFailed(const std::string &detail);
+
+#endif
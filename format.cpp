@@ -0,0 +1,141 @@
+#include "format.h"
+
+#include <cstdio>
+
+/**
+ * Formats a time_t value as "YYYY-MM-DD HH:MM:SS" in UTC.
+ * @param time The Unix timestamp to format.
+ * @return A string representation of the time, or "Invalid Time" if formatting fails.
+ */
+std::string formatTime(time_t time)
+{
+    // std::gmtime returns a shared static buffer; use the reentrant variants so worker threads can format.
+    std::tm tm;
+#ifdef _WIN32
+    if (gmtime_s(&tm, &time) != 0)
+        return "Invalid Time";
+#else
+    if (!gmtime_r(&time, &tm))
+        return "Invalid Time";
+#endif
+    char buffer[20];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+    return std::string(buffer);
+}
+
+/**
+ * Escapes a string for CSV output by wrapping it in quotes if it contains commas, quotes, or newlines.
+ * @param input The string to escape.
+ * @return The escaped string.
+ */
+std::string escapeCSV(const std::string &input)
+{
+    if (input.find_first_of(",\"\n") == std::string::npos)
+    {
+        return input;
+    }
+    std::string escaped = "\"";
+    for (char c : input)
+    {
+        if (c == '"')
+            escaped += "\"\"";
+        else
+            escaped += c;
+    }
+    escaped += "\"";
+    return escaped;
+}
+
+/**
+ * Appends a string as a JSON string literal, escaping quotes, backslashes and control characters.
+ * @param out The string to append to.
+ * @param input The string to quote (UTF-8 is passed through).
+ */
+void appendJSONString(std::string &out, const std::string &input)
+{
+    out += '"';
+    for (char c : input)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned char>(c));
+                out += buffer;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+/**
+ * Quotes a string as a JSON string literal (see appendJSONString()).
+ * @param input The string to quote.
+ * @return The JSON string literal, including the surrounding quotes.
+ */
+std::string escapeJSON(const std::string &input)
+{
+    std::string escaped;
+    appendJSONString(escaped, input);
+    return escaped;
+}
+
+/**
+ * Joins a vector of strings with a separator, escaping each element for CSV.
+ * @param items The vector of strings to join.
+ * @param separator The separator to use.
+ * @return The joined string.
+ */
+std::string joinCSV(const std::vector<std::string> &items, const std::string &separator)
+{
+    std::string result;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        result += escapeCSV(items[i]);
+        if (i < items.size() - 1)
+            result += separator;
+    }
+    return escapeCSV(result);
+}
+
+/**
+ * Appends one '--list' CSV row (path, photo taken time, upload time, people) to a buffer.
+ * @param out The buffer to append to.
+ * @param path The media file path.
+ * @param photoTakenTime The photo taken timestamp.
+ * @param creationTime The upload timestamp.
+ * @param peopleNames The people names, joined with ';'.
+ */
+void appendListRow(std::string &out, const std::string &path, time_t photoTakenTime, time_t creationTime,
+                   const std::vector<std::string> &peopleNames)
+{
+    out += escapeCSV(path);
+    out += ',';
+    out += escapeCSV(formatTime(photoTakenTime));
+    out += ',';
+    out += escapeCSV(formatTime(creationTime));
+    out += ',';
+    out += joinCSV(peopleNames, ";");
+    out += '\n';
+}
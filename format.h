@@ -0,0 +1,16 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+std::string formatTime(time_t time);
+std::string escapeCSV(const std::string &input);
+std::string escapeJSON(const std::string &input);
+void appendJSONString(std::string &out, const std::string &input);
+std::string joinCSV(const std::vector<std::string> &items, const std::string &separator);
+void appendListRow(std::string &out, const std::string &path, time_t photoTakenTime, time_t creationTime,
+                   const std::vector<std::string> &peopleNames);
+
+#endif
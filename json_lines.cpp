@@ -0,0 +1,111 @@
+#include "json_lines.h"
+#include "format.h"
+
+#include <charconv>
+#include <cstdint>
+#include <sstream>
+
+/**
+ * Parses a '--fields' list. "file", "takenTime", "uploadTime" and "peopleNames" are derived by the scanner;
+ * any other name is a dotted sidecar member path such as "geoData.latitude" or "favorited".
+ * @param list Comma-separated field names.
+ * @param fields Receives the fields in output order.
+ * @param rawFields Receives the sidecar member paths to extract (ScanOptions::rawFields).
+ * @return False if the list is empty or names a field twice.
+ */
+bool parseJSONLFields(const std::string &list, std::vector<JSONLField> &fields, std::vector<std::string> &rawFields)
+{
+    fields.clear();
+    rawFields.clear();
+    std::stringstream ss(list);
+    std::string name;
+    while (std::getline(ss, name, ','))
+    {
+        if (name.empty())
+            continue;
+        for (const auto &field : fields)
+        {
+            if (field.key == name)
+                return false;
+        }
+        JSONLField field{JSONLField::Sidecar, name};
+        if (name == "file")
+            field.kind = JSONLField::File;
+        else if (name == "takenTime")
+            field.kind = JSONLField::TakenTime;
+        else if (name == "uploadTime")
+            field.kind = JSONLField::UploadTime;
+        else if (name == "peopleNames")
+            field.kind = JSONLField::PeopleNames;
+        else
+        {
+            field.rawIndex = rawFields.size();
+            rawFields.push_back(name);
+        }
+        fields.push_back(field);
+    }
+    return !fields.empty();
+}
+
+/**
+ * Appends a number in decimal.
+ */
+static void appendNumber(std::string &out, int64_t value)
+{
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+/**
+ * Appends one record as a JSON object on its own line. Sidecar members are copied from the compact text
+ * captured while reading, so nothing is re-serialized.
+ * @param out The string to append to.
+ * @param record The media file and its metadata.
+ * @param fields The members to write, in order.
+ */
+void appendJSONLRow(std::string &out, const MediaRecord &record, const std::vector<JSONLField> &fields)
+{
+    char separator = '{';
+    for (const auto &field : fields)
+    {
+        out += separator;
+        separator = ',';
+        appendJSONString(out, field.key);
+        out += ':';
+        switch (field.kind)
+        {
+        case JSONLField::File:
+            appendJSONString(out, record.path);
+            break;
+        case JSONLField::TakenTime:
+            appendNumber(out, static_cast<int64_t>(record.photoTakenTime));
+            break;
+        case JSONLField::UploadTime:
+            appendNumber(out, static_cast<int64_t>(record.creationTime));
+            break;
+        case JSONLField::PeopleNames:
+        {
+            char nameSeparator = '[';
+            for (const auto &name : record.peopleNames)
+            {
+                out += nameSeparator;
+                nameSeparator = ',';
+                appendJSONString(out, name);
+            }
+            out += record.peopleNames.empty() ? "[]" : "]";
+            break;
+        }
+        case JSONLField::Sidecar:
+        {
+            const std::string &value = record.rawValues[field.rawIndex];
+            if (value.empty())
+                out += "null";
+            else
+                out += value;
+            break;
+        }
+        }
+    }
+    out += "}\n";
+}
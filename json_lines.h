@@ -0,0 +1,31 @@
+#ifndef JSON_LINES_H
+#define JSON_LINES_H
+
+#include "sidecar.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * One member of a '--format jsonl' row: a value the scanner derives, or a sidecar member copied verbatim.
+ */
+struct JSONLField
+{
+    enum Kind
+    {
+        File,        // "file": path of the media file
+        TakenTime,   // "takenTime": photoTakenTime.timestamp as a number
+        UploadTime,  // "uploadTime": creationTime.timestamp as a number
+        PeopleNames, // "peopleNames": array of people[].name
+        Sidecar      // Any other name: the sidecar member at that dotted path, or null
+    };
+
+    Kind kind;
+    std::string key;     // Member name in the output
+    size_t rawIndex = 0; // Index into MediaRecord::rawValues for Kind::Sidecar
+};
+
+bool parseJSONLFields(const std::string &list, std::vector<JSONLField> &fields, std::vector<std::string> &rawFields);
+void appendJSONLRow(std::string &out, const MediaRecord &record, const std::vector<JSONLField> &fields);
+
+#endif
@@ -0,0 +1,184 @@
+#include "json_scan.h"
+
+#include <cstring>
+
+/**
+ * @return The first non-whitespace position at or after p.
+ */
+static const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+/**
+ * Skips a string literal.
+ * @param p Position of the opening quote.
+ * @return The position after the closing quote, or nullptr if the string is unterminated.
+ */
+static const char *skipString(const char *p, const char *end)
+{
+    for (++p; p < end; ++p)
+    {
+        if (*p == '\\')
+            ++p;
+        else if (*p == '"')
+            return p + 1;
+    }
+    return nullptr;
+}
+
+/**
+ * Skips one value without validating it beyond bracket and string structure.
+ * @param p Position of the first byte of the value.
+ * @return The position after the value, or nullptr if it is truncated.
+ */
+static const char *skipValue(const char *p, const char *end)
+{
+    if (p >= end)
+        return nullptr;
+    if (*p == '"')
+        return skipString(p, end);
+    if (*p != '{' && *p != '[')
+    {
+        // Number, true, false or null
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+            ++p;
+        return p;
+    }
+    size_t depth = 0;
+    while (p < end)
+    {
+        if (*p == '"')
+        {
+            p = skipString(p, end);
+            if (!p)
+                return nullptr;
+            continue;
+        }
+        if (*p == '{' || *p == '[')
+            ++depth;
+        else if ((*p == '}' || *p == ']') && --depth == 0)
+            return p + 1;
+        ++p;
+    }
+    return nullptr;
+}
+
+/**
+ * Finds the value of one member in an object, or of one element in an array for an all-digit key.
+ * @param p Position of the value to search.
+ * @param key The member name, matched against the raw (unescaped) bytes of the keys.
+ * @param value Receives the member's value.
+ * @return True if found.
+ */
+static bool findChild(const char *p, const char *end, const char *key, size_t keyLength, JSONSpan &value)
+{
+    if (p >= end || (*p != '{' && *p != '['))
+        return false;
+    bool isArray = *p == '[';
+    size_t index = 0;
+    if (isArray)
+    {
+        if (keyLength == 0)
+            return false;
+        for (size_t i = 0; i < keyLength; ++i)
+        {
+            if (key[i] < '0' || key[i] > '9')
+                return false;
+            index = index * 10 + static_cast<size_t>(key[i] - '0');
+        }
+    }
+
+    p = skipSpace(p + 1, end);
+    if (p < end && (*p == '}' || *p == ']'))
+        return false;
+    for (size_t position = 0; p < end; ++position)
+    {
+        bool match;
+        if (isArray)
+        {
+            match = position == index;
+        }
+        else
+        {
+            if (*p != '"')
+                return false;
+            const char *keyEnd = skipString(p, end);
+            if (!keyEnd)
+                return false;
+            match = static_cast<size_t>(keyEnd - p - 2) == keyLength && std::memcmp(p + 1, key, keyLength) == 0;
+            p = skipSpace(keyEnd, end);
+            if (p >= end || *p != ':')
+                return false;
+            p = skipSpace(p + 1, end);
+        }
+        const char *valueEnd = skipValue(p, end);
+        if (!valueEnd)
+            return false;
+        if (match)
+        {
+            value.begin = p;
+            value.end = valueEnd;
+            return true;
+        }
+        p = skipSpace(valueEnd, end);
+        if (p >= end || *p != ',')
+            return false;
+        p = skipSpace(p + 1, end);
+    }
+    return false;
+}
+
+/**
+ * Locates a member of a JSON document by a dotted path ("geoData.latitude", "people.0.name") without
+ * building a DOM. Only the bytes up to the member are looked at, and no value is decoded.
+ * @param begin Start of the document.
+ * @param end End of the document.
+ * @param path Member names separated by '.'; all-digit names index arrays.
+ * @param value Receives the byte range of the value.
+ * @return True if the member exists.
+ */
+bool findJSONMember(const char *begin, const char *end, const std::string &path, JSONSpan &value)
+{
+    const char *p = skipSpace(begin, end);
+    size_t start = 0;
+    while (true)
+    {
+        size_t dot = path.find('.', start);
+        size_t length = (dot == std::string::npos ? path.size() : dot) - start;
+        if (!findChild(p, end, path.data() + start, length, value))
+            return false;
+        if (dot == std::string::npos)
+            return true;
+        p = value.begin;
+        start = dot + 1;
+    }
+}
+
+/**
+ * Appends a value's bytes verbatim except for whitespace outside strings, so pretty-printed sidecar
+ * values fit on one line.
+ * @param out The string to append to.
+ * @param value The value.
+ */
+void appendCompactJSON(std::string &out, const JSONSpan &value)
+{
+    const char *p = value.begin;
+    while (p < value.end)
+    {
+        const char *run = p;
+        while (p < value.end && *p != '"' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+            ++p;
+        if (p < value.end && *p == '"')
+        {
+            const char *stringEnd = skipString(p, value.end);
+            p = stringEnd ? stringEnd : value.end;
+            out.append(run, p);
+            continue;
+        }
+        out.append(run, p);
+        p = skipSpace(p, value.end);
+    }
+}
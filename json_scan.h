@@ -0,0 +1,18 @@
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <string>
+
+/**
+ * Byte range of one JSON value inside a document.
+ */
+struct JSONSpan
+{
+    const char *begin = nullptr;
+    const char *end = nullptr;
+};
+
+bool findJSONMember(const char *begin, const char *end, const std::string &path, JSONSpan &value);
+void appendCompactJSON(std::string &out, const JSONSpan &value);
+
+#endif
@@ -0,0 +1,224 @@
+#include "latency.h"
+#include "output_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const char *ioClassNames[] = {"stat", "open", "read", "write", "set-times", "set-creation-time", "tags"};
+    static_assert(sizeof(ioClassNames) / sizeof(ioClassNames[0]) == static_cast<size_t>(IoClass::Count),
+                  "ioClassNames must list every IoClass");
+
+    // Log-linear buckets as in HdrHistogram: values below 16 ns are exact, above that every power of two
+    // is split into 16 linear sub-buckets, so a reported value is within 1/16 (6%) of the true one.
+    const int subBucketBits = 4;
+    const int subBucketCount = 1 << subBucketBits;
+    const int maxExponent = 47; // About 39 hours; longer calls land in the last bucket
+    const size_t bucketCount = static_cast<size_t>(maxExponent - subBucketBits + 2) * subBucketCount;
+
+    /**
+     * Histograms of one thread. Only the owning thread writes the counts; they are atomics so a periodic
+     * dump can read them while the run continues, but relaxed loads and stores keep recording cheap.
+     */
+    struct ThreadHistograms
+    {
+        std::atomic<uint64_t> counts[static_cast<size_t>(IoClass::Count)][bucketCount] = {};
+        std::atomic<int64_t> maxNs[static_cast<size_t>(IoClass::Count)] = {};
+    };
+
+    std::atomic<bool> enabled(false);
+    std::mutex registryMutex; // Taken once per thread on first use, and by readers
+    std::vector<std::unique_ptr<ThreadHistograms>> registry;
+
+    std::thread dumpThread;
+    std::mutex dumpMutex;
+    std::condition_variable dumpWake;
+    bool dumpStopRequested = false;
+}
+
+/**
+ * Returns the calling thread's histograms, registering them on first use.
+ */
+static ThreadHistograms &threadHistograms()
+{
+    thread_local ThreadHistograms *histograms = nullptr;
+    if (!histograms)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.emplace_back(new ThreadHistograms());
+        histograms = registry.back().get();
+    }
+    return *histograms;
+}
+
+/**
+ * Maps a duration to its bucket.
+ * @param value Duration in nanoseconds.
+ * @return The bucket index.
+ */
+static size_t bucketIndex(uint64_t value)
+{
+    if (value < static_cast<uint64_t>(subBucketCount))
+        return static_cast<size_t>(value);
+    int exponent = 63;
+    while (!(value >> exponent))
+        --exponent;
+    if (exponent > maxExponent)
+        return bucketCount - 1;
+    size_t subBucket = static_cast<size_t>(value >> (exponent - subBucketBits)) & (subBucketCount - 1);
+    return static_cast<size_t>(exponent - subBucketBits + 1) * subBucketCount + subBucket;
+}
+
+/**
+ * Returns a representative value (the midpoint) of a bucket.
+ * @param index The bucket index.
+ * @return Duration in nanoseconds.
+ */
+static double bucketValue(size_t index)
+{
+    if (index < static_cast<size_t>(subBucketCount))
+        return static_cast<double>(index);
+    int exponent = static_cast<int>(index / subBucketCount) + subBucketBits - 1;
+    double width = static_cast<double>(uint64_t(1) << (exponent - subBucketBits));
+    return (subBucketCount + index % subBucketCount) * width + width / 2;
+}
+
+/**
+ * Turns on latency recording for this run.
+ */
+void enableLatencyHistograms()
+{
+    enabled = true;
+}
+
+/**
+ * @return True if '--latency' is active.
+ */
+bool latencyHistogramsEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Adds one call to the calling thread's histogram of an I/O class.
+ * @param ioClass The kind of call.
+ * @param nanoseconds How long it took.
+ */
+void recordLatency(IoClass ioClass, int64_t nanoseconds)
+{
+    if (nanoseconds < 0)
+        nanoseconds = 0;
+    ThreadHistograms &histograms = threadHistograms();
+    size_t cls = static_cast<size_t>(ioClass);
+    std::atomic<uint64_t> &count = histograms.counts[cls][bucketIndex(static_cast<uint64_t>(nanoseconds))];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (nanoseconds > histograms.maxNs[cls].load(std::memory_order_relaxed))
+        histograms.maxNs[cls].store(nanoseconds, std::memory_order_relaxed);
+}
+
+/**
+ * Starts timing an I/O call.
+ * @param ioClass The kind of call.
+ */
+IoTimer::IoTimer(IoClass ioClass) : ioClass_(ioClass)
+{
+    if (latencyHistogramsEnabled())
+        start_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Records the elapsed time.
+ */
+IoTimer::~IoTimer()
+{
+    if (start_)
+        recordLatency(ioClass_, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() - start_);
+}
+
+/**
+ * Prints count, p50, p99, p999 and maximum latency per I/O class, merged over all threads.
+ * Safe to call while the run is in progress; counts are then a recent snapshot.
+ * @param out The stream to print to.
+ */
+void printLatencyHistograms(std::ostream &out)
+{
+    std::vector<uint64_t> merged(bucketCount);
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(1);
+    out << std::left << std::setw(19) << "Latency (us)" << std::right << std::setw(10) << "count" << std::setw(10) << "p50"
+        << std::setw(10) << "p99" << std::setw(10) << "p999" << std::setw(12) << "max" << "\n";
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t cls = 0; cls < static_cast<size_t>(IoClass::Count); ++cls)
+    {
+        std::fill(merged.begin(), merged.end(), 0);
+        uint64_t total = 0;
+        int64_t maxNs = 0;
+        for (const auto &histograms : registry)
+        {
+            for (size_t i = 0; i < bucketCount; ++i)
+                merged[i] += histograms->counts[cls][i].load(std::memory_order_relaxed);
+            maxNs = std::max(maxNs, histograms->maxNs[cls].load(std::memory_order_relaxed));
+        }
+        for (uint64_t count : merged)
+            total += count;
+        if (total == 0)
+            continue;
+
+        out << std::left << std::setw(19) << ioClassNames[cls] << std::right << std::setw(10) << total;
+        for (double quantile : {0.5, 0.99, 0.999})
+        {
+            // Smallest bucket whose cumulative count covers the quantile
+            uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total - 1)) + 1;
+            uint64_t seen = 0;
+            size_t i = 0;
+            while ((seen += merged[i]) < rank)
+                ++i;
+            out << std::setw(10) << std::min(bucketValue(i), static_cast<double>(maxNs)) / 1000;
+        }
+        out << std::setw(12) << maxNs / 1000.0 << "\n";
+    }
+    out.flags(flags);
+}
+
+/**
+ * Starts a thread that prints the histograms to stderr every few seconds while the run continues.
+ * @param intervalSeconds Seconds between dumps.
+ */
+void startLatencyDumps(unsigned intervalSeconds)
+{
+    dumpStopRequested = false;
+    dumpThread = std::thread([intervalSeconds]()
+                             {
+        std::unique_lock<std::mutex> lock(dumpMutex);
+        while (!dumpWake.wait_for(lock, std::chrono::seconds(intervalSeconds), []
+                                  { return dumpStopRequested; }))
+        {
+            std::ostringstream text;
+            printLatencyHistograms(text);
+            writeOutput(OutputStream::Err, text.str());
+        } });
+}
+
+/**
+ * Stops the periodic dumps started by startLatencyDumps(), if any.
+ */
+void stopLatencyDumps()
+{
+    if (!dumpThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(dumpMutex);
+        dumpStopRequested = true;
+    }
+    dumpWake.notify_all();
+    dumpThread.join();
+}
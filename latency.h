@@ -0,0 +1,44 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <cstdint>
+#include <ostream>
+
+enum class IoClass
+{
+    Stat,            // Existence checks
+    Open,
+    Read,
+    Write,           // In-place metadata writes
+    SetTimes,        // utimensat, or SetFileTime on Windows
+    SetCreationTime, // setattrlist (macOS)
+    Tags,            // Finder tag reads and writes, stored as extended attributes (macOS)
+    Count
+};
+
+void enableLatencyHistograms();
+bool latencyHistogramsEnabled();
+void recordLatency(IoClass ioClass, int64_t nanoseconds);
+void printLatencyHistograms(std::ostream &out);
+void startLatencyDumps(unsigned intervalSeconds);
+void stopLatencyDumps();
+
+/**
+ * Records the duration of a scope in the histogram of one I/O class.
+ * Does nothing unless histograms are enabled.
+ */
+class IoTimer
+{
+public:
+    explicit IoTimer(IoClass ioClass);
+    ~IoTimer();
+
+    IoTimer(const IoTimer &) = delete;
+    IoTimer &operator=(const IoTimer &) = delete;
+
+private:
+    IoClass ioClass_;
+    int64_t start_ = 0;
+};
+
+#endif
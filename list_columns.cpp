@@ -0,0 +1,165 @@
+#include "list_columns.h"
+#include "format.h"
+
+#include <sstream>
+
+namespace
+{
+    /**
+     * Name on the command line and CSV header of each column, in ListColumn order.
+     */
+    struct ColumnName
+    {
+        const char *option;
+        const char *header;
+    };
+
+    const ColumnName columnNames[] = {
+        {"path", "File"},
+        {"taken", "PhotoTakenTime"},
+        {"uploaded", "UploadTime"},
+        {"people", "People"},
+        {"kind", "Kind"},
+        {"sidecar", "Sidecar"},
+    };
+    static_assert(sizeof(columnNames) / sizeof(columnNames[0]) == static_cast<size_t>(ListColumn::Count),
+                  "columnNames must list every ListColumn");
+
+    /**
+     * Appends one column of a row.
+     */
+    template <ListColumn column>
+    void appendColumn(std::string &out, const MediaRecord &record);
+
+    template <>
+    void appendColumn<ListColumn::Path>(std::string &out, const MediaRecord &record)
+    {
+        out += escapeCSV(record.path);
+    }
+
+    template <>
+    void appendColumn<ListColumn::Taken>(std::string &out, const MediaRecord &record)
+    {
+        out += escapeCSV(formatTime(record.photoTakenTime));
+    }
+
+    template <>
+    void appendColumn<ListColumn::Uploaded>(std::string &out, const MediaRecord &record)
+    {
+        out += escapeCSV(formatTime(record.creationTime));
+    }
+
+    template <>
+    void appendColumn<ListColumn::People>(std::string &out, const MediaRecord &record)
+    {
+        out += joinCSV(record.peopleNames, ";");
+    }
+
+    template <>
+    void appendColumn<ListColumn::Kind>(std::string &out, const MediaRecord &record)
+    {
+        out += record.companion ? "live-video" : "primary";
+    }
+
+    template <>
+    void appendColumn<ListColumn::Sidecar>(std::string &out, const MediaRecord &record)
+    {
+        switch (record.sidecarKind)
+        {
+        case SidecarKind::SupplementalMetadata:
+            out += "supplemental-metadata";
+            break;
+        case SidecarKind::Suppl:
+            out += "suppl";
+            break;
+        case SidecarKind::None:
+            out += "none";
+            break;
+        }
+    }
+
+    // Column writers in ListColumn order
+    void (*const columnWriters[])(std::string &, const MediaRecord &) = {
+        &appendColumn<ListColumn::Path>,
+        &appendColumn<ListColumn::Taken>,
+        &appendColumn<ListColumn::Uploaded>,
+        &appendColumn<ListColumn::People>,
+        &appendColumn<ListColumn::Kind>,
+        &appendColumn<ListColumn::Sidecar>,
+    };
+}
+
+/**
+ * Starts with the default columns: path, taken, uploaded and people.
+ */
+ListRowWriter::ListRowWriter()
+{
+    selectColumns("path,taken,uploaded,people");
+}
+
+/**
+ * Selects the columns to write, in order.
+ * @param list Comma-separated column names: path, taken, uploaded, people, kind, sidecar.
+ * @return False (leaving the selection unchanged) if a name is unknown or repeated, or none is given.
+ */
+bool ListRowWriter::selectColumns(const std::string &list)
+{
+    std::vector<ListColumn> columns;
+    std::stringstream ss(list);
+    std::string name;
+    while (std::getline(ss, name, ','))
+    {
+        if (name.empty())
+            continue;
+        size_t index = 0;
+        while (index < static_cast<size_t>(ListColumn::Count) && name != columnNames[index].option)
+            ++index;
+        if (index == static_cast<size_t>(ListColumn::Count))
+            return false;
+        for (ListColumn selected : columns)
+        {
+            if (selected == static_cast<ListColumn>(index))
+                return false;
+        }
+        columns.push_back(static_cast<ListColumn>(index));
+    }
+    if (columns.empty())
+        return false;
+
+    columns_ = columns;
+    writers_.clear();
+    for (ListColumn column : columns_)
+        writers_.push_back(columnWriters[static_cast<size_t>(column)]);
+    return true;
+}
+
+/**
+ * Appends the CSV header line for the selected columns.
+ * @param out The string to append to.
+ */
+void ListRowWriter::appendHeader(std::string &out) const
+{
+    for (size_t i = 0; i < columns_.size(); ++i)
+    {
+        if (i > 0)
+            out += ',';
+        out += columnNames[static_cast<size_t>(columns_[i])].header;
+    }
+    out += '\n';
+}
+
+/**
+ * Appends one CSV row with the selected columns.
+ * @param out The string to append to.
+ * @param record The media file and its metadata.
+ */
+void ListRowWriter::appendRow(std::string &out, const MediaRecord &record) const
+{
+    for (size_t i = 0; i < writers_.size(); ++i)
+    {
+        if (i > 0)
+            out += ',';
+        writers_[i](out, record);
+    }
+    out += '\n';
+}
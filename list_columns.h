@@ -0,0 +1,44 @@
+#ifndef LIST_COLUMNS_H
+#define LIST_COLUMNS_H
+
+#include "sidecar.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * A column of '--list' output.
+ */
+enum class ListColumn
+{
+    Path,     // "path": File
+    Taken,    // "taken": PhotoTakenTime
+    Uploaded, // "uploaded": UploadTime
+    People,   // "people": People, separated by ';'
+    Kind,     // "kind": Kind, "primary" or "live-video"
+    Sidecar,  // "sidecar": Sidecar, "supplemental-metadata", "suppl" or "none"
+    Count
+};
+
+/**
+ * Formats '--list' rows for a chosen list of columns. Each column has its own writer, instantiated from
+ * a template at compile time; the row writer is put together from them once at startup, so columns that
+ * are not selected cost nothing per row.
+ */
+class ListRowWriter
+{
+public:
+    ListRowWriter();
+
+    bool selectColumns(const std::string &list);
+    void appendHeader(std::string &out) const;
+    void appendRow(std::string &out, const MediaRecord &record) const;
+
+private:
+    using ColumnWriter = void (*)(std::string &out, const MediaRecord &record);
+
+    std::vector<ListColumn> columns_;
+    std::vector<ColumnWriter> writers_;
+};
+
+#endif
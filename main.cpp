@@ -1,83 +1,100 @@
+#include <cerrno>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
 #include <string>
 #include <ctime>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <set>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstdint>
 #include <vector>
 #include <sstream>
-#include <nlohmann/json.hpp>
+
+#include "arrow_writer.h"
+#include "compressed_output.h"
+#include "error_log.h"
+#include "exif.h"
+#include "external_sort.h"
+#include "format.h"
+#include "json_lines.h"
+#include "latency.h"
+#include "list_columns.h"
+#include "metrics_file.h"
+#include "output_writer.h"
+#include "process_stats.h"
+#include "progress.h"
+#include "row_sorter.h"
+#include "run_stats.h"
+#include "takeout.h"
+#include "trace.h"
 
 #ifdef _WIN32
-#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
 #else
-#include <sys/time.h>
-#include <unistd.h>
+#include "query_server.h"
 #endif
 
-#ifdef __APPLE__
-#include "mac_tags.h"
-#endif
-
-using json = nlohmann::json;
 namespace fs = std::filesystem;
 
-/**
- * Formats a time_t value as "YYYY-MM-DD HH:MM:SS" in UTC.
- * @param time The Unix timestamp to format.
- * @return A string representation of the time, or "Invalid Time" if formatting fails.
- */
-std::string formatTime(time_t time)
-{
-    std::tm *tm = std::gmtime(&time);
-    if (!tm)
-        return "Invalid Time";
-    char buffer[20];
-    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", tm);
-    return std::string(buffer);
-}
+// In-memory budget for '--sort' when no '--memory-limit' is given; larger exports are merge-sorted on disk.
+static const size_t defaultSortMemory = size_t(512) * 1024 * 1024;
+
+// Members of '--format jsonl' rows when no '--fields' is given
+static const char *const defaultJSONLFields = "file,takenTime,uploadTime,peopleNames";
+
+// Seconds between '--metrics-file' updates; node_exporter typically scrapes every 15 to 60 seconds.
+static const unsigned metricsInterval = 10;
 
 /**
- * Escapes a string for CSV output by wrapping it in quotes if it contains commas, quotes, or newlines.
- * @param input The string to escape.
- * @return The escaped string.
+ * Sends std::cout to another stream buffer until restored or destroyed.
  */
-std::string escapeCSV(const std::string &input)
+class StdoutRedirect
 {
-    if (input.find_first_of(",\"\n") == std::string::npos)
-    {
-        return input;
-    }
-    std::string escaped = "\"";
-    for (char c : input)
+public:
+    ~StdoutRedirect() { restore(); }
+
+    void redirect(std::streambuf *buffer) { saved_ = std::cout.rdbuf(buffer); }
+
+    void restore()
     {
-        if (c == '"')
-            escaped += "\"\"";
-        else
-            escaped += c;
+        if (!saved_)
+            return;
+        std::cout.flush();
+        std::cout.rdbuf(saved_);
+        saved_ = nullptr;
     }
-    escaped += "\"";
-    return escaped;
-}
+
+private:
+    std::streambuf *saved_ = nullptr;
+};
 
 /**
- * Joins a vector of strings with a separator, escaping each element for CSV.
- * @param items The vector of strings to join.
- * @param separator The separator to use.
- * @return The joined string.
+ * Appends a '--compare-exif' row for a photo whose EXIF time disagrees with its sidecar.
+ * @param out The string to append to.
+ * @param record The photo, with its EXIF dates.
+ * @param difference EXIF minus sidecar time in seconds.
+ * @param mismatch The kind of disagreement.
  */
-std::string joinCSV(const std::vector<std::string> &items, const std::string &separator)
+static void appendExifRow(std::string &out, const MediaRecord &record, int64_t difference, ExifMismatch mismatch)
 {
-    std::string result;
-    for (size_t i = 0; i < items.size(); ++i)
-    {
-        result += escapeCSV(items[i]);
-        if (i < items.size() - 1)
-            result += separator;
-    }
-    return escapeCSV(result);
+    out += escapeCSV(record.path);
+    out += ',';
+    out += escapeCSV(formatTime(record.photoTakenTime));
+    out += ',';
+    out += escapeCSV(record.exifDateTime);
+    out += ',';
+    out += escapeCSV(record.exifOffsetTime);
+    out += ',';
+    out += std::to_string(difference);
+    out += ',';
+    out += mismatch == ExifMismatch::TimeZone ? "timezone" : "clock";
+    out += '\n';
 }
 
 /**
@@ -89,298 +106,39 @@ void printHelp()
               << "Options:\n"
               << "  --help                    Display this help message\n"
               << "  --list                    List files with creation, upload times, and people as CSV\n"
+              << "  --sort taken|uploaded|path Sort --list output by photo taken time, upload time or path\n"
+              << "  --format csv|arrow|jsonl  Output format of --list; arrow and jsonl imply --list\n"
+              << "  --columns <c1,...>        Columns of CSV --list rows: path, taken, uploaded, people, kind, sidecar\n"
+              << "  --fields <f1,...>         Members of each jsonl row: file, takenTime, uploadTime, peopleNames or sidecar paths\n"
+              << "  --video-fallback          Also process .mp4/.mov/.m4v videos without a sidecar, dated from their 'mvhd' box\n"
+              << "  --compare-exif            List photos whose EXIF DateTimeOriginal disagrees with the sidecar as CSV\n"
               << "  --set-file-dates          Set file dates based on metadata\n"
+              << "  --write-exif              Overwrite the EXIF DateTimeOriginal of JPEG and HEIC photos in place\n"
+              << "  --write-video-dates       Overwrite the mvhd/tkhd creation and modification times of videos in place\n"
 #ifdef __APPLE__
               << "  --assign-people-tags \"tag1;...\" Assign specified Finder Tags from JSON 'people' names (macOS only, semicolon-separated)\n"
               << "  --assign-all-people-tags  Assign all 'people' names as Finder Tags (macOS only)\n"
               << "  --remove-all-tags         Remove all Finder Tags from files (macOS only)\n"
               << "  --remove-named-tags \"tag1;...\" Remove specific Finder Tags (macOS only, semicolon-separated)\n"
 #endif
-              << "  --list-tags               List unique 'people' names from JSON files\n";
-}
-
-/**
- * Sets the creation and modification times of a file (platform-specific).
- * @param filePath The path to the file.
- * @param photoTakenTime The timestamp for the creation time.
- * @param creationTime The timestamp for the modification time (upload time).
- * @return True if successful, false otherwise.
- */
-bool setFileTimes(const fs::path &filePath, time_t photoTakenTime, time_t creationTime)
-{
-#ifdef _WIN32
-    // Windows-specific: Use CreateFileA and SetFileTime
-    HANDLE hFile = CreateFileA(filePath.string().c_str(), GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE)
-    {
-        std::cerr << "Failed to open " << filePath << ": " << GetLastError() << std::endl;
-        return false;
-    }
-    FILETIME ftCreation, ftModification;
-    LONGLONG llCreation = Int32x32To64(photoTakenTime, 10000000) + 116444736000000000LL;
-    LONGLONG llModification = Int32x32To64(creationTime, 10000000) + 116444736000000000LL;
-    ftCreation.dwLowDateTime = (DWORD)llCreation;
-    ftCreation.dwHighDateTime = (DWORD)(llCreation >> 32);
-    ftModification.dwLowDateTime = (DWORD)llModification;
-    ftModification.dwHighDateTime = (DWORD)(llModification >> 32);
-    if (!SetFileTime(hFile, &ftCreation, NULL, &ftModification))
-    {
-        std::cerr << "Failed to set times for " << filePath << ": " << GetLastError() << std::endl;
-        CloseHandle(hFile);
-        return false;
-    }
-    CloseHandle(hFile);
-    return true;
-#else
-    // POSIX (Linux/macOS)
-    struct timespec times[2];
-    times[0].tv_sec = UTIME_OMIT; // Leave access time unchanged
-    times[0].tv_nsec = UTIME_OMIT;
-    times[1].tv_sec = creationTime; // Modification time (upload time)
-    times[1].tv_nsec = 0;
-
-    int fd = open(filePath.string().c_str(), O_WRONLY);
-    if (fd == -1)
-    {
-        std::cerr << "Failed to open " << filePath << ": " << strerror(errno) << std::endl;
-        return false;
-    }
-
-    if (utimensat(AT_FDCWD, filePath.string().c_str(), times, 0) != 0)
-    {
-        std::cerr << "Failed to set modification time for " << filePath << ": " << strerror(errno) << std::endl;
-        close(fd);
-        return false;
-    }
-#ifdef __APPLE__
-    // macOS-specific: Set creation time
-    if (!setCreationTime(filePath.string(), photoTakenTime))
-    {
-        close(fd);
-        return false;
-    }
-#endif
-    close(fd);
-    return true;
-#endif
-}
-
-/**
- * Processes a Google Photos metadata JSON file.
- * Supports .supplemental-metadata.json and .suppl.json suffixes.
- * Handles date setting, tag listing, and tag assignment/removal based on mode.
- * @param jsonPath Path to the metadata JSON file.
- * @param listOnly If true, lists files with times and people.
- * @param setDates If true, sets file dates.
- * @param listTags If true, lists unique people tags.
- * @param assignPeopleTags If true, assigns specified tags (macOS only).
- * @param peopleTagsToAssign Tags to assign (if assignPeopleTags is true).
- * @param assignAllPeopleTags If true, assigns all people names as tags (macOS only).
- * @param removeAllTags If true, removes all tags (macOS only).
- * @param removeNamedTags If true, removes specified tags (macOS only).
- * @param tagsToRemove Tags to remove (if removeNamedTags is true).
- * @param allPeopleTags Accumulates unique people tags (for --list-tags).
- */
-void processFile(const fs::path &jsonPath, bool listOnly, bool setDates, bool listTags,
-                 bool assignPeopleTags, const std::vector<std::string> &peopleTagsToAssign,
-                 bool assignAllPeopleTags, bool removeAllTags, bool removeNamedTags,
-                 const std::vector<std::string> &tagsToRemove, std::set<std::string> &allPeopleTags)
-{
-    std::ifstream jsonFile(jsonPath);
-    if (!jsonFile.is_open())
-        return;
-
-    json j;
-    try
-    {
-        jsonFile >> j;
-    }
-    catch (const json::exception &e)
-    {
-        std::cerr << "Error parsing JSON " << jsonPath << ": " << e.what() << std::endl;
-        return;
-    }
-
-    std::string jsonFileName = jsonPath.filename().string();
-    std::string baseFileName;
-
-    if (jsonFileName.find(".supplemental-metadata.json") != std::string::npos)
-    {
-        baseFileName = jsonFileName.substr(0, jsonFileName.find(".supplemental-metadata.json"));
-    }
-    else if (jsonFileName.find(".suppl.json") != std::string::npos)
-    {
-        baseFileName = jsonFileName.substr(0, jsonFileName.find(".suppl.json"));
-    }
-    else
-    {
-        return; // Not a recognized metadata file
-    }
-
-    fs::path parentDir = jsonPath.parent_path();
-    fs::path primaryPath = parentDir / baseFileName;
-
-    if (!fs::exists(primaryPath) && !listTags)
-    {
-        std::cerr << "Primary file " << primaryPath << " does not exist" << std::endl;
-        return;
-    }
-
-    std::string primaryStem = primaryPath.stem().string();
-    time_t photoTakenTime = std::stol(j["photoTakenTime"]["timestamp"].get<std::string>());
-    time_t creationTime = std::stol(j["creationTime"]["timestamp"].get<std::string>());
-
-    // Extract people names from JSON
-    std::vector<std::string> peopleNames;
-    if (j.contains("people") && j["people"].is_array())
-    {
-        for (const auto &person : j["people"])
-        {
-            if (person.contains("name") && person["name"].is_string())
-            {
-                peopleNames.push_back(person["name"].get<std::string>());
-                if (listTags)
-                {
-                    allPeopleTags.insert(person["name"].get<std::string>());
-                }
-            }
-        }
-    }
-
-    if (listOnly)
-    {
-        std::cout << escapeCSV(primaryPath.string()) << ","
-                  << escapeCSV(formatTime(photoTakenTime)) << ","
-                  << escapeCSV(formatTime(creationTime)) << ","
-                  << joinCSV(peopleNames, ";") << "\n";
-
-        fs::path mp4Path = parentDir / (primaryStem + ".MP4");
-        fs::path mp4JsonPath = parentDir / (primaryStem + ".MP4.supplemental-metadata.json");
-        fs::path mp4SupplJsonPath = parentDir / (primaryStem + ".MP4.suppl.json");
-        if (fs::exists(mp4Path) && !fs::exists(mp4JsonPath) && !fs::exists(mp4SupplJsonPath))
-        {
-            std::cout << escapeCSV(mp4Path.string()) << ","
-                      << escapeCSV(formatTime(photoTakenTime)) << ","
-                      << escapeCSV(formatTime(creationTime)) << ","
-                      << joinCSV(peopleNames, ";") << "\n";
-        }
-    }
-    else if (setDates)
-    {
-        setFileTimes(primaryPath, photoTakenTime, creationTime);
-
-        fs::path mp4Path = parentDir / (primaryStem + ".MP4");
-        fs::path mp4JsonPath = parentDir / (primaryStem + ".MP4.supplemental-metadata.json");
-        fs::path mp4SupplJsonPath = parentDir / (primaryStem + ".MP4.suppl.json");
-        if (fs::exists(mp4Path) && !fs::exists(mp4JsonPath) && !fs::exists(mp4SupplJsonPath))
-        {
-            setFileTimes(mp4Path, photoTakenTime, creationTime);
-        }
-
-        fs::path mp4LowerPath = parentDir / (primaryStem + ".mp4");
-        fs::path mp4LowerJsonPath = parentDir / (primaryStem + ".mp4.supplemental-metadata.json");
-        fs::path mp4LowerSupplJsonPath = parentDir / (primaryStem + ".mp4.suppl.json");
-        if (fs::exists(mp4LowerPath) && !fs::exists(mp4LowerJsonPath) && !fs::exists(mp4LowerSupplJsonPath) && !fs::equivalent(mp4LowerPath, mp4Path))
-        {
-            setFileTimes(mp4LowerPath, photoTakenTime, creationTime);
-        }
-    }
-#ifdef __APPLE__
-    else if (assignPeopleTags)
-    {
-        std::vector<std::string> tagsToApply;
-        for (const auto &tag : peopleTagsToAssign)
-        {
-            if (std::find(peopleNames.begin(), peopleNames.end(), tag) != peopleNames.end())
-            {
-                tagsToApply.push_back(tag);
-            }
-        }
-        if (!tagsToApply.empty())
-        {
-            setFinderTags(primaryPath.string(), tagsToApply);
-
-            fs::path mp4Path = parentDir / (primaryStem + ".MP4");
-            fs::path mp4JsonPath = parentDir / (primaryStem + ".MP4.supplemental-metadata.json");
-            fs::path mp4SupplJsonPath = parentDir / (primaryStem + ".MP4.suppl.json");
-            if (fs::exists(mp4Path) && !fs::exists(mp4JsonPath) && !fs::exists(mp4SupplJsonPath))
-            {
-                setFinderTags(mp4Path.string(), tagsToApply);
-            }
-
-            fs::path mp4LowerPath = parentDir / (primaryStem + ".mp4");
-            fs::path mp4LowerJsonPath = parentDir / (primaryStem + ".mp4.supplemental-metadata.json");
-            fs::path mp4LowerSupplJsonPath = parentDir / (primaryStem + ".mp4.suppl.json");
-            if (fs::exists(mp4LowerPath) && !fs::exists(mp4LowerJsonPath) && !fs::exists(mp4LowerSupplJsonPath) && !fs::equivalent(mp4LowerPath, mp4Path))
-            {
-                setFinderTags(mp4LowerPath.string(), tagsToApply);
-            }
-        }
-    }
-    else if (assignAllPeopleTags)
-    {
-        if (!peopleNames.empty())
-        {
-            setFinderTags(primaryPath.string(), peopleNames);
-
-            fs::path mp4Path = parentDir / (primaryStem + ".MP4");
-            fs::path mp4JsonPath = parentDir / (primaryStem + ".MP4.supplemental-metadata.json");
-            fs::path mp4SupplJsonPath = parentDir / (primaryStem + ".MP4.suppl.json");
-            if (fs::exists(mp4Path) && !fs::exists(mp4JsonPath) && !fs::exists(mp4SupplJsonPath))
-            {
-                setFinderTags(mp4Path.string(), peopleNames);
-            }
-
-            fs::path mp4LowerPath = parentDir / (primaryStem + ".mp4");
-            fs::path mp4LowerJsonPath = parentDir / (primaryStem + ".mp4.supplemental-metadata.json");
-            fs::path mp4LowerSupplJsonPath = parentDir / (primaryStem + ".mp4.suppl.json");
-            if (fs::exists(mp4LowerPath) && !fs::exists(mp4LowerJsonPath) && !fs::exists(mp4LowerSupplJsonPath) && !fs::equivalent(mp4LowerPath, mp4Path))
-            {
-                setFinderTags(mp4LowerPath.string(), peopleNames);
-            }
-        }
-    }
-    else if (removeAllTags)
-    {
-        removeAllFinderTags(primaryPath.string());
-
-        fs::path mp4Path = parentDir / (primaryStem + ".MP4");
-        fs::path mp4JsonPath = parentDir / (primaryStem + ".MP4.supplemental-metadata.json");
-        fs::path mp4SupplJsonPath = parentDir / (primaryStem + ".MP4.suppl.json");
-        if (fs::exists(mp4Path) && !fs::exists(mp4JsonPath) && !fs::exists(mp4SupplJsonPath))
-        {
-            removeAllFinderTags(mp4Path.string());
-        }
-
-        fs::path mp4LowerPath = parentDir / (primaryStem + ".mp4");
-        fs::path mp4LowerJsonPath = parentDir / (primaryStem + ".mp4.supplemental-metadata.json");
-        fs::path mp4LowerSupplJsonPath = parentDir / (primaryStem + ".mp4.suppl.json");
-        if (fs::exists(mp4LowerPath) && !fs::exists(mp4LowerJsonPath) && !fs::exists(mp4LowerSupplJsonPath) && !fs::equivalent(mp4LowerPath, mp4Path))
-        {
-            removeAllFinderTags(mp4LowerPath.string());
-        }
-    }
-    else if (removeNamedTags)
-    {
-        removeNamedFinderTags(primaryPath.string(), tagsToRemove);
-
-        fs::path mp4Path = parentDir / (primaryStem + ".MP4");
-        fs::path mp4JsonPath = parentDir / (primaryStem + ".MP4.supplemental-metadata.json");
-        fs::path mp4SupplJsonPath = parentDir / (primaryStem + ".MP4.suppl.json");
-        if (fs::exists(mp4Path) && !fs::exists(mp4JsonPath) && !fs::exists(mp4SupplJsonPath))
-        {
-            removeNamedFinderTags(mp4Path.string(), tagsToRemove);
-        }
-
-        fs::path mp4LowerPath = parentDir / (primaryStem + ".mp4");
-        fs::path mp4LowerJsonPath = parentDir / (primaryStem + ".mp4.supplemental-metadata.json");
-        fs::path mp4LowerSupplJsonPath = parentDir / (primaryStem + ".mp4.suppl.json");
-        if (fs::exists(mp4LowerPath) && !fs::exists(mp4LowerJsonPath) && !fs::exists(mp4LowerSupplJsonPath) && !fs::equivalent(mp4LowerPath, mp4Path))
-        {
-            removeNamedFinderTags(mp4LowerPath.string(), tagsToRemove);
-        }
-    }
+              << "  --list-tags               List unique 'people' names from JSON files\n"
+              << "  --jobs <n>                Process sidecars on n threads; output keeps the serial order\n"
+              << "  --error-log <file>        Write errors as JSON lines to a file instead of stderr\n"
+              << "  --memory-limit <size>     Bound memory (e.g. 512M, 2G); large sets spill to sorted temp files\n"
+              << "  --progress                Show files/s, MB/s and an ETA on stderr while running\n"
+              << "  --stats                   Print per-phase times and I/O counters to stderr at exit\n"
+              << "  --stats-json <file>       Write the same statistics as JSON to a file\n"
+              << "  --latency                 Print p50/p99/p999 latency per I/O call type to stderr at exit\n"
+              << "  --latency-interval <sec>  Also print the latency table every sec seconds during the run\n"
+              << "  --output <file>           Write stdout to a file, gzip- or zstd-compressed for .gz or .zst names\n"
+              << "  --metrics-file <file>     Keep run metrics in a Prometheus textfile, updated every 10 seconds\n"
+              << "  --trace <file>            Write a Chrome/Perfetto trace of batches and per-file phases\n"
+              << "  --trace-sample <n>        Record one in n per-file trace spans per thread (default 16)\n"
+#ifndef _WIN32
+              << "  --serve <socket>          Keep the metadata index in memory and answer queries on a Unix socket\n"
+              << "  --reload-interval <sec>   Seconds between rescans for changed sidecars in --serve mode (default 5, 0 = never)\n"
 #endif
+              ;
 }
 
 /**
@@ -401,7 +159,16 @@ int main(int argc, char *argv[])
 
     std::string folder = argv[1];
     bool listOnly = false;
+    bool sortList = false;
+    bool arrowOutput = false;
+    bool jsonlOutput = false;
+    std::string fieldList = defaultJSONLFields;
+    std::string columnList;
+    bool compareExif = false;
+    bool videoFallback = false;
     bool setDates = false;
+    bool writeExif = false;
+    bool writeVideoDates = false;
     bool listTags = false;
     bool assignPeopleTags = false;
     bool assignAllPeopleTags = false;
@@ -409,7 +176,21 @@ int main(int argc, char *argv[])
     bool removeNamedTags = false;
     std::vector<std::string> peopleTagsToAssign;
     std::vector<std::string> tagsToRemove;
-    std::set<std::string> allPeopleTags;
+    unsigned jobs = 1;
+    size_t memoryLimit = 0;
+    std::string errorLogPath;
+    bool showProgress = false;
+    bool printRunStats = false;
+    std::string statsJSONPath;
+    bool printLatency = false;
+    unsigned latencyInterval = 0;
+    std::string metricsPath;
+    std::string outputPath;
+    std::string tracePath;
+    unsigned traceSample = 16;
+    SortKey sortKey = SortKey::Taken;
+    std::string serveSocket;
+    int reloadInterval = 5;
 
     for (int i = 2; i < argc; ++i)
     {
@@ -423,10 +204,56 @@ int main(int argc, char *argv[])
         {
             listOnly = true;
         }
+        else if (arg == "--sort" && i + 1 < argc)
+        {
+            sortList = true;
+            if (!parseSortKey(argv[++i], sortKey))
+            {
+                std::cerr << "Invalid sort key: " << argv[i] << " (expected taken, uploaded or path)" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--format" && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            if (format != "csv" && format != "arrow" && format != "jsonl")
+            {
+                std::cerr << "Invalid format: " << format << " (expected csv, arrow or jsonl)" << std::endl;
+                return 1;
+            }
+            arrowOutput = format == "arrow";
+            jsonlOutput = format == "jsonl";
+            listOnly = listOnly || arrowOutput || jsonlOutput;
+        }
+        else if (arg == "--columns" && i + 1 < argc)
+        {
+            columnList = argv[++i];
+        }
+        else if (arg == "--fields" && i + 1 < argc)
+        {
+            fieldList = argv[++i];
+        }
+        else if (arg == "--video-fallback")
+        {
+            videoFallback = true;
+        }
+        else if (arg == "--compare-exif")
+        {
+            compareExif = true;
+            listOnly = true;
+        }
         else if (arg == "--set-file-dates")
         {
             setDates = true;
         }
+        else if (arg == "--write-exif")
+        {
+            writeExif = true;
+        }
+        else if (arg == "--write-video-dates")
+        {
+            writeVideoDates = true;
+        }
         else if (arg == "--list-tags")
         {
             listTags = true;
@@ -463,6 +290,103 @@ int main(int argc, char *argv[])
                     tagsToRemove.push_back(tag);
             }
         }
+        else if (arg == "--jobs" && i + 1 < argc)
+        {
+            int requested = std::atoi(argv[++i]);
+            if (requested < 1)
+            {
+                std::cerr << "Invalid job count: " << argv[i] << std::endl;
+                return 1;
+            }
+            jobs = static_cast<unsigned>(requested);
+        }
+        else if (arg == "--error-log" && i + 1 < argc)
+        {
+            errorLogPath = argv[++i];
+        }
+        else if (arg == "--progress")
+        {
+            showProgress = true;
+        }
+        else if (arg == "--stats")
+        {
+            printRunStats = true;
+        }
+        else if (arg == "--stats-json" && i + 1 < argc)
+        {
+            statsJSONPath = argv[++i];
+        }
+        else if (arg == "--latency")
+        {
+            printLatency = true;
+        }
+        else if (arg == "--latency-interval" && i + 1 < argc)
+        {
+            int requested = std::atoi(argv[++i]);
+            if (requested < 1)
+            {
+                std::cerr << "Invalid latency interval: " << argv[i] << std::endl;
+                return 1;
+            }
+            printLatency = true;
+            latencyInterval = static_cast<unsigned>(requested);
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+            if (!outputCodecAvailable(outputCodecFor(outputPath)))
+            {
+                std::cerr << "Compression for " << outputPath << " is not available in this build" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--metrics-file" && i + 1 < argc)
+        {
+            metricsPath = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+        }
+        else if (arg == "--trace-sample" && i + 1 < argc)
+        {
+            int requested = std::atoi(argv[++i]);
+            if (requested < 1)
+            {
+                std::cerr << "Invalid trace sample interval: " << argv[i] << std::endl;
+                return 1;
+            }
+            traceSample = static_cast<unsigned>(requested);
+        }
+        else if (arg == "--memory-limit" && i + 1 < argc)
+        {
+            memoryLimit = parseByteSize(argv[++i]);
+            if (memoryLimit == 0)
+            {
+                std::cerr << "Invalid memory limit: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+#ifndef _WIN32
+        else if (arg == "--serve" && i + 1 < argc)
+        {
+            serveSocket = argv[++i];
+        }
+        else if (arg == "--reload-interval" && i + 1 < argc)
+        {
+            // 0 is valid (never rescan), so atoi's 0 for bad input cannot be told apart; parse strictly
+            const char *text = argv[++i];
+            char *end = nullptr;
+            errno = 0;
+            long requested = std::strtol(text, &end, 10);
+            if (end == text || *end != '\0' || errno != 0 || requested < 0 || requested > INT_MAX)
+            {
+                std::cerr << "Invalid reload interval: " << text << std::endl;
+                return 1;
+            }
+            reloadInterval = static_cast<int>(requested);
+        }
+#endif
         else
         {
             std::cerr << "Unknown option or missing argument: " << arg << std::endl;
@@ -471,37 +395,321 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Sorted rows are kept as CSV text, and the tag list would follow the stream on stdout
+    if ((arrowOutput || jsonlOutput) && (sortList || listTags))
+    {
+        std::cerr << "--format arrow and jsonl cannot be combined with --sort or --list-tags" << std::endl;
+        return 1;
+    }
+    if (!jsonlOutput && fieldList != defaultJSONLFields)
+    {
+        std::cerr << "--fields requires --format jsonl" << std::endl;
+        return 1;
+    }
+    if ((arrowOutput || jsonlOutput) && !columnList.empty())
+    {
+        std::cerr << "--columns applies to --format csv only" << std::endl;
+        return 1;
+    }
+    if (compareExif && (arrowOutput || jsonlOutput || sortList || !columnList.empty()))
+    {
+        std::cerr << "--compare-exif cannot be combined with --format arrow or jsonl, --sort or --columns" << std::endl;
+        return 1;
+    }
+    ListRowWriter listRowWriter;
+    if (!columnList.empty() && !listRowWriter.selectColumns(columnList))
+    {
+        std::cerr << "Invalid column list: " << columnList << " (expected path, taken, uploaded, people, kind, sidecar)" << std::endl;
+        return 1;
+    }
+    std::vector<JSONLField> jsonlFields;
+    std::vector<std::string> rawFields;
+    if (jsonlOutput && !parseJSONLFields(fieldList, jsonlFields, rawFields))
+    {
+        std::cerr << "Invalid field list: " << fieldList << std::endl;
+        return 1;
+    }
+
+#ifndef __APPLE__
+    // Accepted everywhere so scripts run unchanged, but there is nothing to tag
+    if (assignPeopleTags || assignAllPeopleTags || removeAllTags || removeNamedTags)
+        std::cerr << "Finder Tags are only supported on macOS; the tag options are ignored" << std::endl;
+#endif
     if (!fs::exists(folder))
     {
         std::cerr << "Folder does not exist: " << folder << std::endl;
         return 1;
     }
 
-    if (listOnly)
+#ifndef _WIN32
+    if (!serveSocket.empty())
+    {
+        return runQueryServer(folder, serveSocket, reloadInterval);
+    }
+#endif
+
+    // Half of the limit goes to spillable structures; the rest is headroom for the parser, stream
+    // buffers and the process itself.
+    size_t spillBudget = memoryLimit ? memoryLimit / 2 : SIZE_MAX;
+    ExternalSorter allPeopleTags(spillBudget, true);
+    std::unique_ptr<RowSorter> sortedRows;
+    if (listOnly && sortList)
+        sortedRows.reset(new RowSorter(sortKey, memoryLimit ? spillBudget : defaultSortMemory, listRowWriter));
+
+    // The compressor thread takes whatever std::cout receives, from the output writer and from the end-of-run
+    // listings alike.
+    CompressedFileBuf outputFile;
+    StdoutRedirect stdoutRedirect;
+    if (!outputPath.empty())
+    {
+        if (!outputFile.open(outputPath, outputCodecFor(outputPath)))
+        {
+            std::cerr << "Failed to open output file " << outputPath << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        stdoutRedirect.redirect(&outputFile);
+    }
+
+    std::unique_ptr<ArrowStreamWriter> arrowWriter;
+    if (arrowOutput)
+    {
+#ifdef _WIN32
+        if (outputPath.empty())
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        arrowWriter.reset(new ArrowStreamWriter([](std::string bytes)
+                                                { writeOutput(OutputStream::Out, std::move(bytes)); }));
+    }
+    else if (compareExif)
+    {
+        std::cout << "File,PhotoTakenTime,ExifDateTimeOriginal,ExifOffsetTime,Difference,Cause\n";
+    }
+    else if (listOnly && !jsonlOutput)
+    {
+        std::string header;
+        listRowWriter.appendHeader(header);
+        std::cout << header;
+    }
+
+    std::ofstream errorLog;
+    if (!errorLogPath.empty())
     {
-        std::cout << "File,PhotoTakenTime,UploadTime,People\n";
+        errorLog.open(errorLogPath, std::ios::trunc);
+        if (!errorLog.is_open())
+        {
+            std::cerr << "Failed to open error log " << errorLogPath << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        setErrorLogStream(&errorLog);
+        setStructuredErrorLog(true);
     }
 
-    for (const auto &entry : fs::recursive_directory_iterator(folder))
+    std::ofstream statsJSON;
+    if (!statsJSONPath.empty())
     {
-        std::string filename = entry.path().filename().string();
-        if (entry.path().extension() == ".json" &&
-            (filename.find(".supplemental-metadata.json") != std::string::npos ||
-             filename.find(".suppl.json") != std::string::npos))
+        statsJSON.open(statsJSONPath, std::ios::trunc);
+        if (!statsJSON.is_open())
         {
-            processFile(entry.path(), listOnly, setDates, listTags, assignPeopleTags, peopleTagsToAssign,
-                        assignAllPeopleTags, removeAllTags, removeNamedTags, tagsToRemove, allPeopleTags);
+            std::cerr << "Failed to open stats file " << statsJSONPath << ": " << strerror(errno) << std::endl;
+            return 1;
         }
     }
+    std::ofstream traceFile;
+    if (!tracePath.empty())
+    {
+        traceFile.open(tracePath, std::ios::trunc);
+        if (!traceFile.is_open())
+        {
+            std::cerr << "Failed to open trace file " << tracePath << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        startTrace(traceSample);
+        nameTraceThread(jobs > 1 ? "walker" : "main");
+    }
+    if (printRunStats || statsJSON.is_open() || traceFile.is_open() || !metricsPath.empty())
+        enableStats();
+    if (!metricsPath.empty() && !startMetricsFile(metricsPath, metricsInterval))
+    {
+        flushThreadOutput();
+        return 1;
+    }
+
+    if (printLatency)
+        enableLatencyHistograms();
+
+    auto runStart = std::chrono::steady_clock::now();
+    startOutputWriter();
+    if (latencyInterval)
+        startLatencyDumps(latencyInterval);
+    if (showProgress)
+        startProgress(folder);
+    // '--list-tags' alone needs neither the media files nor their companions. Only one mode is applied:
+    // '--list' wins, then the others in this order.
+    ScanOptions scanOptions;
+    scanOptions.jobs = jobs;
+    scanOptions.requirePrimary = !listTags;
+    scanOptions.companions = !compareExif && (listOnly || !listTags);
+    scanOptions.rawFields = rawFields;
+    scanOptions.readExif = compareExif;
+    scanOptions.videoFallback = videoFallback && !compareExif;
+    if (!listOnly)
+    {
+        // Combine with the other actions: embedded dates are written before the file dates are set
+        scanOptions.actions.writeExifDates = writeExif;
+        scanOptions.actions.writeVideoDates = writeVideoDates;
+        if (setDates)
+            scanOptions.actions.setDates = true;
+#ifdef __APPLE__
+        else if (assignPeopleTags)
+            scanOptions.actions.peopleTagsToAssign = peopleTagsToAssign;
+        else if (assignAllPeopleTags)
+            scanOptions.actions.assignAllPeopleTags = true;
+        else if (removeAllTags)
+            scanOptions.actions.removeAllTags = true;
+        else if (removeNamedTags)
+            scanOptions.actions.tagsToRemove = tagsToRemove;
+#endif
+    }
+
+    std::string listText;
+    size_t exifCompared = 0;
+    size_t exifMissing = 0;
+    std::array<size_t, 3> exifMismatches = {};
+    SidecarStatusCounts sidecarStatusTotals = scanTakeout(
+        folder, scanOptions,
+        [&](std::vector<MediaRecord> &records)
+        {
+            PhaseTimer timer(Phase::Output);
+            if (arrowWriter)
+            {
+                for (const auto &record : records)
+                    arrowWriter->add(record);
+            }
+            else if (jsonlOutput)
+            {
+                for (const auto &record : records)
+                    appendJSONLRow(listText, record, jsonlFields);
+                writeOutput(OutputStream::Out, std::move(listText));
+                listText.clear();
+            }
+            else if (compareExif)
+            {
+                for (const auto &record : records)
+                {
+                    if (record.exifDateTime.empty())
+                    {
+                        exifMissing += isExifImageName(record.path);
+                        continue;
+                    }
+                    int64_t difference;
+                    ExifMismatch mismatch = compareExifTime(record.exifDateTime, record.exifOffsetTime, record.photoTakenTime, difference);
+                    ++exifCompared;
+                    ++exifMismatches[static_cast<size_t>(mismatch)];
+                    if (mismatch != ExifMismatch::None)
+                        appendExifRow(listText, record, difference, mismatch);
+                }
+                writeOutput(OutputStream::Out, std::move(listText));
+                listText.clear();
+            }
+            else if (listOnly)
+            {
+                for (const auto &record : records)
+                {
+                    if (sortedRows)
+                        sortedRows->add(record);
+                    else
+                        listRowWriter.appendRow(listText, record);
+                }
+                writeOutput(OutputStream::Out, std::move(listText));
+                listText.clear();
+            }
+            if (listTags)
+            {
+                // Companions repeat the names of their primary; the sorter drops the duplicates
+                for (auto &record : records)
+                {
+                    for (auto &tag : record.peopleNames)
+                        allPeopleTags.add(std::move(tag));
+                }
+            }
+        });
+    if (arrowWriter)
+    {
+        PhaseTimer timer(Phase::Output);
+        arrowWriter->finish();
+    }
+    stopProgress();
+    stopLatencyDumps();
+    stopOutputWriter();
+    stopMetricsFile();
+
+    // The writer has stopped, so these write std::cout directly; their errors are flushed before the summary
+    int exitCode = 0;
+    if (sortedRows && !sortedRows->writeTo(std::cout))
+        exitCode = 1;
 
     if (listTags)
     {
         std::cout << "Unique People Tags:\n";
-        for (const auto &tag : allPeopleTags)
+        allPeopleTags.forEach([](const std::string &tag)
+                              { std::cout << tag << "\n"; });
+    }
+
+    flushThreadOutput();
+    printErrorSummary(std::cerr);
+    size_t sidecarsSeen = 0;
+    for (size_t count : sidecarStatusTotals)
+        sidecarsSeen += count;
+    if (sidecarStatusTotals[static_cast<size_t>(SidecarStatus::Ok)] != sidecarsSeen)
+    {
+        const char *separator = "Sidecars: ";
+        for (size_t i = 0; i < sidecarStatusTotals.size(); ++i)
         {
-            std::cout << tag << "\n";
+            if (sidecarStatusTotals[i] == 0)
+                continue;
+            std::cerr << separator << sidecarStatusTotals[i] << " " << sidecarStatusName(static_cast<SidecarStatus>(i));
+            separator = ", ";
         }
+        std::cerr << std::endl;
+    }
+    if (compareExif)
+    {
+        size_t timeZone = exifMismatches[static_cast<size_t>(ExifMismatch::TimeZone)];
+        size_t clock = exifMismatches[static_cast<size_t>(ExifMismatch::Clock)];
+        std::cerr << "EXIF: " << exifCompared << " compared, " << timeZone + clock << " differ (" << timeZone
+                  << " timezone, " << clock << " clock), " << exifMissing << " without DateTimeOriginal" << std::endl;
+    }
+
+    if (outputFile.isOpen())
+    {
+        stdoutRedirect.restore();
+        if (!outputFile.close())
+            exitCode = 1;
+    }
+
+    if (memoryLimit)
+    {
+        std::cout.flush();
+        std::cerr << "Peak RSS: " << peakResidentSetBytes() / (1024 * 1024) << " MB (limit "
+                  << memoryLimit / (1024 * 1024) << " MB, " << allPeopleTags.runCount() + (sortedRows ? sortedRows->runCount() : 0) << " spilled runs)" << std::endl;
+    }
+
+    if (printLatency)
+    {
+        std::cout.flush();
+        printLatencyHistograms(std::cerr);
+    }
+    if (traceFile.is_open())
+        writeTrace(traceFile);
+    if (printRunStats || statsJSON.is_open())
+    {
+        double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+        std::cout.flush();
+        if (printRunStats)
+            printStats(std::cerr, runSeconds);
+        if (statsJSON.is_open())
+            writeStatsJSON(statsJSON, runSeconds);
     }
 
-    return 0;
+    return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "media_file.h"
+#include "latency.h"
+#include "progress.h"
+#include "run_stats.h"
+
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Records a call rejected before reaching the system, where lastMediaFileError() finds it.
+ */
+static void setInvalidArgument()
+{
+#ifdef _WIN32
+    SetLastError(ERROR_INVALID_PARAMETER);
+#else
+    errno = EINVAL;
+#endif
+}
+
+/**
+ * Records a write the system accepted no bytes of, where lastMediaFileError() finds it.
+ */
+static void setWriteFault()
+{
+#ifdef _WIN32
+    SetLastError(ERROR_WRITE_FAULT);
+#else
+    errno = EIO;
+#endif
+}
+
+/**
+ * @return Why the last failed MediaFile call on this thread failed: errno, or GetLastError() on Windows
+ *         (reportError() formats either).
+ */
+int lastMediaFileError()
+{
+#ifdef _WIN32
+    return static_cast<int>(GetLastError());
+#else
+    return errno;
+#endif
+}
+
+MediaFile::~MediaFile()
+{
+    close();
+}
+
+/**
+ * Opens a file and records its size, and its access and modification times for restoreTimes().
+ * @param path The file.
+ * @param writable Open for writing as well as reading.
+ * @return False if it cannot be opened (lastMediaFileError() says why).
+ */
+bool MediaFile::open(const std::filesystem::path &path, bool writable)
+{
+    close();
+    countEvent(Counter::OpenCalls);
+    IoTimer ioTimer(IoClass::Open);
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.wstring().c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size))
+    {
+        DWORD error = GetLastError();
+        CloseHandle(handle);
+        SetLastError(error);
+        return false;
+    }
+    if (writable)
+    {
+        FILETIME accessTime, writeTime;
+        if (!GetFileTime(handle, NULL, &accessTime, &writeTime))
+        {
+            DWORD error = GetLastError();
+            CloseHandle(handle);
+            SetLastError(error);
+            return false;
+        }
+        accessTime_ = static_cast<uint64_t>(accessTime.dwHighDateTime) << 32 | accessTime.dwLowDateTime;
+        writeTime_ = static_cast<uint64_t>(writeTime.dwHighDateTime) << 32 | writeTime.dwLowDateTime;
+    }
+    handle_ = handle;
+    size_ = static_cast<uint64_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        int savedErrno = errno;
+        ::close(fd);
+        errno = savedErrno;
+        return false;
+    }
+    fd_ = fd;
+    size_ = static_cast<uint64_t>(info.st_size);
+#ifdef __APPLE__
+    times_[0] = info.st_atimespec;
+    times_[1] = info.st_mtimespec;
+#else
+    times_[0] = info.st_atim;
+    times_[1] = info.st_mtim;
+#endif
+#endif
+    return true;
+}
+
+/**
+ * Closes the file if it is open.
+ */
+void MediaFile::close()
+{
+    if (!isOpen())
+        return;
+    countEvent(Counter::CloseCalls);
+#ifdef _WIN32
+    CloseHandle(static_cast<HANDLE>(handle_));
+    handle_ = nullptr;
+#else
+    ::close(fd_);
+    fd_ = -1;
+#endif
+    size_ = 0;
+}
+
+/**
+ * @return True between a successful open() and close().
+ */
+bool MediaFile::isOpen() const
+{
+#ifdef _WIN32
+    return handle_ != nullptr;
+#else
+    return fd_ >= 0;
+#endif
+}
+
+/**
+ * Reads a range of the file with one positional read (more only if the system returns it in parts).
+ * @param offset The first byte.
+ * @param size Bytes to read; the range is clipped to the end of the file.
+ * @param buffer Receives the bytes; its size is the number read.
+ * @return False on a read error (lastMediaFileError() says why).
+ */
+bool MediaFile::readAt(uint64_t offset, size_t size, std::string &buffer)
+{
+    buffer.clear();
+    if (!isOpen())
+    {
+        setInvalidArgument();
+        return false;
+    }
+    if (offset >= size_)
+        return true;
+    if (size > size_ - offset)
+        size = static_cast<size_t>(size_ - offset);
+    buffer.resize(size);
+
+    PhaseTimer timer(Phase::Read);
+    IoTimer ioTimer(IoClass::Read);
+    size_t done = 0;
+    bool ok = true;
+    while (done < size)
+    {
+        countEvent(Counter::ReadCalls);
+#ifdef _WIN32
+        OVERLAPPED position = {};
+        uint64_t at = offset + done;
+        position.Offset = static_cast<DWORD>(at);
+        position.OffsetHigh = static_cast<DWORD>(at >> 32);
+        DWORD count = 0;
+        size_t remaining = size - done;
+        DWORD request = static_cast<DWORD>(remaining < (1u << 30) ? remaining : (1u << 30));
+        if (!ReadFile(static_cast<HANDLE>(handle_), &buffer[done], request, &count, &position))
+        {
+            ok = false;
+            break;
+        }
+#else
+        ssize_t count = pread(fd_, &buffer[done], size - done, static_cast<off_t>(offset + done));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+        {
+            ok = false;
+            break;
+        }
+#endif
+        if (count == 0)
+            break; // The file shrank
+        done += static_cast<size_t>(count);
+    }
+    buffer.resize(done);
+    countEvent(Counter::BytesRead, done);
+    addProgressBytes(done);
+    return ok;
+}
+
+/**
+ * Overwrites a range of the file in place with one positional write (more only if the system takes it in
+ * parts). The file must be open for writing; it is never extended.
+ * @param offset The first byte.
+ * @param data The new bytes.
+ * @param size Bytes to write; the range must lie within the file.
+ * @return False on a write error (lastMediaFileError() says why).
+ */
+bool MediaFile::writeAt(uint64_t offset, const char *data, size_t size)
+{
+    if (!isOpen() || offset > size_ || size > size_ - offset)
+    {
+        setInvalidArgument();
+        return false;
+    }
+
+    PhaseTimer timer(Phase::Apply);
+    IoTimer ioTimer(IoClass::Write);
+    size_t done = 0;
+    while (done < size)
+    {
+        countEvent(Counter::WriteCalls);
+#ifdef _WIN32
+        OVERLAPPED position = {};
+        uint64_t at = offset + done;
+        position.Offset = static_cast<DWORD>(at);
+        position.OffsetHigh = static_cast<DWORD>(at >> 32);
+        DWORD count = 0;
+        if (!WriteFile(static_cast<HANDLE>(handle_), data + done, static_cast<DWORD>(size - done), &count, &position))
+            return false;
+#else
+        ssize_t count = pwrite(fd_, data + done, size - done, static_cast<off_t>(offset + done));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            return false;
+#endif
+        if (count == 0)
+        {
+            setWriteFault();
+            return false;
+        }
+        done += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+/**
+ * Sets the access and modification times back to what they were at open(), so an in-place write does not
+ * leave the file dated "now". The file must be open for writing.
+ * @return False on error (lastMediaFileError() says why).
+ */
+bool MediaFile::restoreTimes()
+{
+    if (!isOpen())
+    {
+        setInvalidArgument();
+        return false;
+    }
+    countEvent(Counter::SetTimesCalls);
+    IoTimer ioTimer(IoClass::SetTimes);
+#ifdef _WIN32
+    FILETIME accessTime = {static_cast<DWORD>(accessTime_), static_cast<DWORD>(accessTime_ >> 32)};
+    FILETIME writeTime = {static_cast<DWORD>(writeTime_), static_cast<DWORD>(writeTime_ >> 32)};
+    return SetFileTime(static_cast<HANDLE>(handle_), NULL, &accessTime, &writeTime) != 0;
+#else
+    return futimens(fd_, times_) == 0;
+#endif
+}
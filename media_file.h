@@ -0,0 +1,46 @@
+#ifndef MEDIA_FILE_H
+#define MEDIA_FILE_H
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <string>
+
+/**
+ * A media file opened for positional reads and writes (pread and pwrite, or ReadFile and WriteFile at an
+ * offset on Windows), so container parsers can look at and patch a few small ranges of a large file without
+ * touching the rest. Calls are counted in the run statistics and latency histograms like the sidecar reads.
+ */
+class MediaFile
+{
+public:
+    MediaFile() = default;
+    ~MediaFile();
+
+    MediaFile(const MediaFile &) = delete;
+    MediaFile &operator=(const MediaFile &) = delete;
+
+    bool open(const std::filesystem::path &path, bool writable = false);
+    void close();
+    bool isOpen() const;
+    uint64_t size() const { return size_; }
+
+    bool readAt(uint64_t offset, size_t size, std::string &buffer);
+    bool writeAt(uint64_t offset, const char *data, size_t size);
+    bool restoreTimes();
+
+private:
+#ifdef _WIN32
+    void *handle_ = nullptr;
+    uint64_t accessTime_ = 0; // FILETIME values at open(), for files opened for writing
+    uint64_t writeTime_ = 0;
+#else
+    int fd_ = -1;
+    timespec times_[2] = {}; // Access and modification times at open()
+#endif
+    uint64_t size_ = 0;
+};
+
+int lastMediaFileError();
+
+#endif
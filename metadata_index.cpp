@@ -0,0 +1,212 @@
+#include "metadata_index.h"
+#include "output_writer.h"
+#include "sidecar.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+/**
+ * Builds the lookup tables for a set of records.
+ * @param records The records to index; the snapshot takes ownership.
+ */
+MetadataIndex::MetadataIndex(std::vector<MediaRecord> records) : records_(std::move(records))
+{
+    std::sort(records_.begin(), records_.end(), [](const MediaRecord &a, const MediaRecord &b)
+              { return a.photoTakenTime != b.photoTakenTime ? a.photoTakenTime < b.photoTakenTime : a.path < b.path; });
+
+    byPath_.reserve(records_.size());
+    for (size_t i = 0; i < records_.size(); ++i)
+    {
+        byPath_.emplace(records_[i].path, i);
+        for (const auto &name : records_[i].peopleNames)
+        {
+            auto &indices = byPerson_[name];
+            if (indices.empty() || indices.back() != i)
+                indices.push_back(i);
+        }
+    }
+}
+
+/**
+ * Looks up a single media file by its full path.
+ * @param path The path as it appears in '--list' output.
+ * @return The record, or nullptr if the path is not indexed.
+ */
+const MediaRecord *MetadataIndex::find(const std::string &path) const
+{
+    auto it = byPath_.find(path);
+    return it == byPath_.end() ? nullptr : &records_[it->second];
+}
+
+/**
+ * Returns all records whose photo taken time lies in [from, to], ordered by time.
+ * @param from Lower bound (Unix timestamp, inclusive).
+ * @param to Upper bound (Unix timestamp, inclusive).
+ * @param person If not empty, only records that include this person are returned.
+ * @return Pointers into the snapshot, valid as long as the snapshot is alive.
+ */
+std::vector<const MediaRecord *> MetadataIndex::range(time_t from, time_t to, const std::string &person) const
+{
+    std::vector<const MediaRecord *> result;
+    auto byTime = [](const MediaRecord &r, time_t t)
+    { return r.photoTakenTime < t; };
+    size_t first = std::lower_bound(records_.begin(), records_.end(), from, byTime) - records_.begin();
+
+    if (person.empty())
+    {
+        for (size_t i = first; i < records_.size() && records_[i].photoTakenTime <= to; ++i)
+            result.push_back(&records_[i]);
+        return result;
+    }
+
+    auto it = byPerson_.find(person);
+    if (it == byPerson_.end())
+        return result;
+    const auto &indices = it->second;
+    for (auto idx = std::lower_bound(indices.begin(), indices.end(), first);
+         idx != indices.end() && records_[*idx].photoTakenTime <= to; ++idx)
+        result.push_back(&records_[*idx]);
+    return result;
+}
+
+/**
+ * Returns all records that include a person, ordered by photo taken time.
+ * @param person The people name as it appears in the sidecar.
+ * @return Pointers into the snapshot, valid as long as the snapshot is alive.
+ */
+std::vector<const MediaRecord *> MetadataIndex::withPerson(const std::string &person) const
+{
+    std::vector<const MediaRecord *> result;
+    auto it = byPerson_.find(person);
+    if (it == byPerson_.end())
+        return result;
+    result.reserve(it->second.size());
+    for (size_t idx : it->second)
+        result.push_back(&records_[idx]);
+    return result;
+}
+
+/**
+ * @param root The folder to index.
+ */
+MetadataIndexBuilder::MetadataIndexBuilder(fs::path root) : root_(std::move(root))
+{
+}
+
+/**
+ * Reads one sidecar and returns the records for its primary file and companion videos.
+ * @param jsonPath Path to the metadata JSON file.
+ * @param sidecarOk Receives whether the sidecar itself could be read and parsed.
+ * @return The records, or an empty vector if the sidecar is unusable or its primary file is missing.
+ */
+static std::vector<MediaRecord> recordsForSidecar(const fs::path &jsonPath, bool &sidecarOk)
+{
+    std::vector<MediaRecord> records;
+    SidecarMetadata meta;
+    sidecarOk = readSidecar(jsonPath, meta) == SidecarStatus::Ok;
+    if (!sidecarOk || !pathExists(meta.primaryPath))
+        return records;
+
+    records.push_back({meta.primaryPath.string(), meta.photoTakenTime, meta.creationTime, meta.peopleNames});
+
+    std::vector<fs::path> companions;
+    findCompanions(meta.primaryPath, companions);
+    for (const auto &companion : companions)
+        records.push_back({companion.string(), meta.photoTakenTime, meta.creationTime, meta.peopleNames});
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        records[i].companion = i != 0;
+        records[i].sidecarKind = meta.sidecarKind;
+    }
+    return records;
+}
+
+/**
+ * @return True if two record lists name the same files in the same order.
+ */
+static bool samePaths(const std::vector<MediaRecord> &a, const std::vector<MediaRecord> &b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const MediaRecord &x, const MediaRecord &y)
+                      { return x.path == y.path; });
+}
+
+/**
+ * Walks the folder and builds a new snapshot if anything changed.
+ * Sidecars whose size and modification time are unchanged since the last scan reuse their parsed records;
+ * new or modified sidecars are re-read and removed ones are dropped. Sidecars in a folder whose modification
+ * time changed are read again too, so a companion video added or removed next to them is picked up.
+ * @param changedSidecars Receives the number of sidecars whose records were added, modified or removed.
+ * @return The new snapshot, or the previous one if nothing changed.
+ */
+std::shared_ptr<const MetadataIndex> MetadataIndexBuilder::rescan(size_t &changedSidecars)
+{
+    changedSidecars = 0;
+    std::unordered_map<std::string, SidecarEntry> seen;
+    seen.reserve(sidecars_.size());
+    fs::path directory;
+    fs::file_time_type directoryWriteTime;
+
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(root_, fs::directory_options::skip_permission_denied, ec), end;
+         !ec && it != end; it.increment(ec))
+    {
+        const fs::directory_entry &entry = *it;
+        if (!isSidecarName(entry.path().filename().string()))
+            continue;
+
+        std::error_code statError;
+        fs::file_time_type lastWriteTime = entry.last_write_time(statError);
+        std::uintmax_t fileSize = statError ? 0 : entry.file_size(statError);
+        if (statError)
+            continue;
+        // The walk visits a folder's files together, so this is one stat per folder
+        if (entry.path().parent_path() != directory)
+        {
+            directory = entry.path().parent_path();
+            directoryWriteTime = fs::last_write_time(directory, statError);
+        }
+
+        std::string key = entry.path().string();
+        auto previous = sidecars_.find(key);
+        bool known = previous != sidecars_.end();
+        bool unchanged = known && previous->second.lastWriteTime == lastWriteTime && previous->second.fileSize == fileSize;
+        bool sameDirectory = known && previous->second.directoryWriteTime == directoryWriteTime;
+        bool hadRecords = known && !previous->second.records.empty();
+        // A valid sidecar whose primary file is missing is retried on every scan, so a primary file that
+        // shows up later gets indexed without touching its sidecar. Broken sidecars wait until they change.
+        if (unchanged && ((hadRecords && sameDirectory) || !previous->second.sidecarOk))
+        {
+            seen.emplace(key, std::move(previous->second));
+            continue;
+        }
+
+        SidecarEntry sidecar;
+        sidecar.lastWriteTime = lastWriteTime;
+        sidecar.directoryWriteTime = directoryWriteTime;
+        sidecar.fileSize = fileSize;
+        sidecar.records = recordsForSidecar(entry.path(), sidecar.sidecarOk);
+        if (unchanged ? !samePaths(previous->second.records, sidecar.records) : hadRecords || !sidecar.records.empty())
+            ++changedSidecars;
+        seen.emplace(key, std::move(sidecar));
+    }
+    if (ec)
+        std::cerr << "Error scanning " << root_ << ": " << ec.message() << std::endl;
+
+    for (const auto &old : sidecars_)
+    {
+        if (!old.second.records.empty() && seen.find(old.first) == seen.end())
+            ++changedSidecars;
+    }
+    sidecars_ = std::move(seen);
+    flushThreadOutput(); // readSidecar reports errors through the thread's output buffer
+    if (changedSidecars == 0 && snapshot_)
+        return snapshot_;
+
+    std::vector<MediaRecord> records;
+    for (const auto &sidecar : sidecars_)
+        records.insert(records.end(), sidecar.second.records.begin(), sidecar.second.records.end());
+    snapshot_ = std::make_shared<const MetadataIndex>(std::move(records));
+    return snapshot_;
+}
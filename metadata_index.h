@@ -0,0 +1,60 @@
+#ifndef METADATA_INDEX_H
+#define METADATA_INDEX_H
+
+#include "sidecar.h"
+
+#include <ctime>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Immutable, query-ready snapshot of all media records under a folder.
+ * Snapshots are never modified after construction, so any number of threads may query one concurrently.
+ */
+class MetadataIndex
+{
+public:
+    explicit MetadataIndex(std::vector<MediaRecord> records);
+
+    const MediaRecord *find(const std::string &path) const;
+    std::vector<const MediaRecord *> range(time_t from, time_t to, const std::string &person) const;
+    std::vector<const MediaRecord *> withPerson(const std::string &person) const;
+    size_t size() const { return records_.size(); }
+
+private:
+    std::vector<MediaRecord> records_; // Sorted by photoTakenTime
+    std::unordered_map<std::string, size_t> byPath_;
+    std::unordered_map<std::string, std::vector<size_t>> byPerson_; // Ascending record indices
+};
+
+/**
+ * Scans a folder for sidecars and builds MetadataIndex snapshots.
+ * Keeps the parsed records of every sidecar so rescans only re-read sidecars that changed.
+ */
+class MetadataIndexBuilder
+{
+public:
+    explicit MetadataIndexBuilder(std::filesystem::path root);
+
+    std::shared_ptr<const MetadataIndex> rescan(size_t &changedSidecars);
+
+private:
+    struct SidecarEntry
+    {
+        std::filesystem::file_time_type lastWriteTime;
+        std::filesystem::file_time_type directoryWriteTime; // Of the folder, which changes as companions come and go
+        std::uintmax_t fileSize = 0;
+        bool sidecarOk = false;
+        std::vector<MediaRecord> records;
+    };
+
+    std::filesystem::path root_;
+    std::unordered_map<std::string, SidecarEntry> sidecars_;
+    std::shared_ptr<const MetadataIndex> snapshot_;
+};
+
+#endif
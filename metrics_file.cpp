@@ -0,0 +1,104 @@
+#include "metrics_file.h"
+#include "error_log.h"
+#include "output_writer.h"
+#include "run_stats.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    std::string metricsPath;
+    std::chrono::steady_clock::time_point startTime;
+    std::thread updateThread;
+    std::mutex updateMutex;
+    std::condition_variable updateWake;
+    bool updateStopRequested = false;
+}
+
+/**
+ * Writes the metrics to a temporary file next to the target and renames it over the target, so a
+ * collector never reads a partially written file.
+ * @param complete True for the final update.
+ * @return True on success.
+ */
+static bool writeMetrics(bool complete)
+{
+    std::string temporaryPath = metricsPath + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::trunc);
+        if (!out.is_open())
+        {
+            reportError(ErrorCode::MetricsWriteFailed, errno, temporaryPath);
+            return false;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        writeStatsPrometheus(out, seconds, complete);
+        if (!out.flush())
+        {
+            reportError(ErrorCode::MetricsWriteFailed, errno, temporaryPath);
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temporaryPath, metricsPath, ec);
+    if (ec)
+    {
+        reportError(ErrorCode::MetricsWriteFailed, ec.value(), metricsPath, ec.message());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Starts writing run metrics for node_exporter's textfile collector: once now and then every few seconds
+ * until stopMetricsFile(). Stats collection must be enabled.
+ * @param path Target file (conventionally ending in '.prom').
+ * @param intervalSeconds Seconds between updates.
+ * @return False if the file cannot be written (the error has been reported).
+ */
+bool startMetricsFile(const std::string &path, unsigned intervalSeconds)
+{
+    metricsPath = path;
+    startTime = std::chrono::steady_clock::now();
+    if (!writeMetrics(false))
+        return false;
+
+    updateStopRequested = false;
+    updateThread = std::thread([intervalSeconds]()
+                               {
+        std::unique_lock<std::mutex> lock(updateMutex);
+        while (!updateWake.wait_for(lock, std::chrono::seconds(intervalSeconds), []
+                                    { return updateStopRequested; }))
+        {
+            // reportError() buffers per thread; hand this thread's errors to the output writer
+            writeMetrics(false);
+            flushThreadOutput();
+        } });
+    return true;
+}
+
+/**
+ * Stops the periodic updates and writes the final metrics. Called after stopOutputWriter(), so an error
+ * from the final write is printed right away.
+ */
+void stopMetricsFile()
+{
+    if (!updateThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        updateStopRequested = true;
+    }
+    updateWake.notify_all();
+    updateThread.join();
+    writeMetrics(true);
+    flushThreadOutput();
+}
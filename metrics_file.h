@@ -0,0 +1,9 @@
+#ifndef METRICS_FILE_H
+#define METRICS_FILE_H
+
+#include <string>
+
+bool startMetricsFile(const std::string &path, unsigned intervalSeconds);
+void stopMetricsFile();
+
+#endif
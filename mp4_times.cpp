@@ -0,0 +1,306 @@
+#include "mp4_times.h"
+#include "media_file.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Each read fetches at least this much, so the boxes at the start of the file (and the children at the
+    // start of a 'moov' found further in) arrive in one call.
+    const size_t readBlockBytes = 4096;
+
+    // Boxes to walk at one level before giving up on a damaged or unusual file
+    const int maxBoxes = 64;
+
+    // Seconds from 1904-01-01, the MP4 epoch, to 1970-01-01
+    const uint64_t mp4EpochOffset = 2082844800;
+
+    uint32_t readBE32(const unsigned char *p)
+    {
+        return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+               static_cast<uint32_t>(p[2]) << 8 | p[3];
+    }
+
+    uint64_t readBE64(const unsigned char *p)
+    {
+        return static_cast<uint64_t>(readBE32(p)) << 32 | readBE32(p + 4);
+    }
+
+    /**
+     * Positional reads of a file through a per-thread block cache. A box header after a large 'mdat'
+     * costs one read at its offset; nothing in between is read.
+     */
+    class BoxReader
+    {
+    public:
+        explicit BoxReader(MediaFile &file) : file_(file)
+        {
+            cache_.clear();
+        }
+
+        /**
+         * @param offset File offset of the range.
+         * @param size Bytes needed (at most readBlockBytes).
+         * @return The bytes, or null if the range is past the end of the file.
+         */
+        const unsigned char *data(uint64_t offset, size_t size)
+        {
+            if (offset < cacheStart_ || offset - cacheStart_ + size > cache_.size())
+            {
+                if (!file_.readAt(offset, std::max(size, readBlockBytes), cache_))
+                {
+                    failed_ = true;
+                    cache_.clear();
+                    return nullptr;
+                }
+                cacheStart_ = offset;
+                if (cache_.size() < size)
+                    return nullptr;
+            }
+            return reinterpret_cast<const unsigned char *>(cache_.data()) + (offset - cacheStart_);
+        }
+
+        bool failed() const { return failed_; }
+
+    private:
+        MediaFile &file_;
+        uint64_t cacheStart_ = 0;
+        bool failed_ = false;
+        static thread_local std::string cache_;
+    };
+
+    thread_local std::string BoxReader::cache_;
+
+    /**
+     * An ISO BMFF box.
+     */
+    struct Box
+    {
+        char type[4];
+        uint64_t start; // File offset of the payload
+        uint64_t size;  // Payload bytes
+    };
+
+    /**
+     * Reads a box header, including the 64-bit size form used by large 'mdat' boxes.
+     * @param end File offset where the enclosing box ends; a size of 0 extends the box to it.
+     */
+    bool readBox(BoxReader &reader, uint64_t pos, uint64_t end, Box &box)
+    {
+        if (end - pos < 8)
+            return false;
+        const unsigned char *header = reader.data(pos, 16 <= end - pos ? 16 : 8);
+        if (!header)
+            return false;
+        uint64_t size = readBE32(header);
+        std::memcpy(box.type, header + 4, 4);
+        uint64_t headerSize = 8;
+        if (size == 1)
+        {
+            if (end - pos < 16)
+                return false;
+            size = readBE64(header + 8);
+            headerSize = 16;
+        }
+        else if (size == 0)
+        {
+            size = end - pos;
+        }
+        if (size < headerSize || size > end - pos)
+            return false;
+        box.start = pos + headerSize;
+        box.size = size - headerSize;
+        return true;
+    }
+
+    /**
+     * @return True if a box type is four printable characters, as in every MP4 and QuickTime file.
+     */
+    bool isBoxType(const char *type)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            if (type[i] < 0x20 || type[i] > 0x7e)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Finds the first box of a type among the boxes from pos to end.
+     */
+    bool findBox(BoxReader &reader, uint64_t pos, uint64_t end, const char *type, Box &box)
+    {
+        for (int i = 0; i < maxBoxes && pos < end; ++i)
+        {
+            if (!readBox(reader, pos, end, box) || (i == 0 && !isBoxType(box.type)))
+                return false;
+            if (std::memcmp(box.type, type, 4) == 0)
+                return true;
+            pos = box.start + box.size;
+        }
+        return false;
+    }
+
+    /**
+     * Finds the 'moov' box and its 'mvhd' child.
+     */
+    bool findMovieHeader(BoxReader &reader, uint64_t fileSize, Box &moov, Box &mvhd)
+    {
+        return findBox(reader, 0, fileSize, "moov", moov) &&
+               findBox(reader, moov.start, moov.start + moov.size, "mvhd", mvhd);
+    }
+
+    /**
+     * Converts an MP4 time stamp; 0 (and anything before 1970) means unset.
+     */
+    bool toUnixTime(uint64_t mp4Time, time_t &seconds)
+    {
+        if (mp4Time <= mp4EpochOffset)
+            return false;
+        seconds = static_cast<time_t>(mp4Time - mp4EpochOffset);
+        return true;
+    }
+}
+
+/**
+ * @param path A media file.
+ * @return True if its extension is one readMovieHeader() is meant for: .mp4, .mov or .m4v, in any case.
+ */
+bool isVideoName(const fs::path &path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+    return extension == ".mp4" || extension == ".mov" || extension == ".m4v";
+}
+
+/**
+ * Reads the creation and modification times of an MP4 or QuickTime movie from its 'mvhd' box.
+ * Only box headers are read: the top-level boxes are walked by their sizes (64-bit ones included), so
+ * a 'moov' after a multi-gigabyte 'mdat' is found with one more read, and 'mvhd' is usually its first child.
+ * @param path The video.
+ * @param header Receives the times and the position of the 'mvhd' payload.
+ * @return Whether a creation time was found; MovieStatus::Unreadable leaves lastMediaFileError() set.
+ */
+MovieStatus readMovieHeader(const fs::path &path, MovieHeader &header)
+{
+    header = MovieHeader();
+    MediaFile file;
+    if (!file.open(path))
+        return MovieStatus::Unreadable;
+
+    BoxReader reader(file);
+    Box moov, mvhd;
+    const unsigned char *first = reader.data(0, 8);
+    if (!first || !isBoxType(reinterpret_cast<const char *>(first) + 4))
+        return reader.failed() ? MovieStatus::Unreadable : MovieStatus::Unsupported;
+    if (!findMovieHeader(reader, file.size(), moov, mvhd))
+        return reader.failed() ? MovieStatus::Unreadable : MovieStatus::NoDate;
+
+    // A full box: version and flags, then 32-bit (version 0) or 64-bit (version 1) times
+    const unsigned char *payload = reader.data(mvhd.start, 20);
+    if (!payload || mvhd.size < 20 || payload[0] > 1)
+        return reader.failed() ? MovieStatus::Unreadable : MovieStatus::NoDate;
+    header.version = payload[0];
+    header.position = mvhd.start;
+    uint64_t creation = header.version == 1 ? readBE64(payload + 4) : readBE32(payload + 4);
+    uint64_t modification = header.version == 1 ? readBE64(payload + 12) : readBE32(payload + 8);
+    if (!toUnixTime(creation, header.creationTime))
+        return MovieStatus::NoDate;
+    if (!toUnixTime(modification, header.modificationTime))
+        header.modificationTime = header.creationTime;
+    return MovieStatus::Found;
+}
+
+/**
+ * Sets creation_time and modification_time in the 'mvhd' box and in the 'tkhd' box of every track, in
+ * place. The fields have a fixed width, so each box costs one small positional write (none if it already
+ * holds the time) and the movie is never remuxed. Finding the boxes costs one read per track on top of
+ * what readMovieHeader() reads. Every header is checked before the first write, so a movie is either
+ * updated completely or not at all.
+ * @param path The video.
+ * @param time The new time (seconds since 1970, UTC).
+ * @param keepFileTimes Set the access and modification times back after writing.
+ * @return What was done; MovieWriteStatus::Failed leaves lastMediaFileError() set.
+ */
+MovieWriteStatus writeMovieTimes(const fs::path &path, time_t time, bool keepFileTimes)
+{
+    // Compare on a read-only handle, so a read-only movie that already holds the time is Unchanged
+    MediaFile file;
+    if (!file.open(path))
+        return MovieWriteStatus::Failed;
+
+    BoxReader reader(file);
+    Box moov, mvhd;
+    const unsigned char *first = reader.data(0, 8);
+    if (!first || !isBoxType(reinterpret_cast<const char *>(first) + 4) ||
+        !findMovieHeader(reader, file.size(), moov, mvhd))
+        return reader.failed() ? MovieWriteStatus::Failed : MovieWriteStatus::NotInPlace;
+
+    // The boxes to patch: 'mvhd', then 'moov/trak/tkhd'
+    std::vector<Box> headers(1, mvhd);
+    uint64_t pos = moov.start;
+    uint64_t moovEnd = moov.start + moov.size;
+    Box child, tkhd;
+    for (int i = 0; i < maxBoxes && pos < moovEnd && readBox(reader, pos, moovEnd, child); ++i)
+    {
+        if (std::memcmp(child.type, "trak", 4) == 0 && findBox(reader, child.start, child.start + child.size, "tkhd", tkhd))
+            headers.push_back(tkhd);
+        pos = child.start + child.size;
+    }
+    if (reader.failed())
+        return MovieWriteStatus::Failed;
+
+    // Version 0 has two 32-bit times after the version and flags, version 1 two 64-bit ones
+    struct Patch
+    {
+        uint64_t position; // File offset of the times
+        size_t size;       // Bytes of both times
+        char times[16];
+    };
+    std::vector<Patch> patches;
+    uint64_t mp4Time = static_cast<uint64_t>(time) + mp4EpochOffset;
+    for (const Box &header : headers)
+    {
+        const unsigned char *version = reader.data(header.start, 4);
+        if (!version || version[0] > 1)
+            return reader.failed() ? MovieWriteStatus::Failed : MovieWriteStatus::NotInPlace;
+        size_t width = version[0] == 1 ? 8 : 4;
+        // A damaged box too short for its times would have the write spill into the next box
+        if (header.size < 4 + 2 * width || (width == 4 && mp4Time > UINT32_MAX))
+            return MovieWriteStatus::NotInPlace;
+        Patch patch;
+        patch.position = header.start + 4;
+        patch.size = 2 * width;
+        for (size_t i = 0; i < width; ++i)
+            patch.times[i] = patch.times[width + i] = static_cast<char>(mp4Time >> (8 * (width - 1 - i)));
+        const unsigned char *current = reader.data(patch.position, patch.size);
+        if (!current)
+            return reader.failed() ? MovieWriteStatus::Failed : MovieWriteStatus::NotInPlace;
+        if (std::memcmp(current, patch.times, patch.size) != 0)
+            patches.push_back(patch);
+    }
+
+    if (patches.empty())
+        return MovieWriteStatus::Unchanged;
+
+    // writeAt() refuses ranges past the end, should the movie have shrunk since it was read
+    if (!file.open(path, true))
+        return MovieWriteStatus::Failed;
+    for (const Patch &patch : patches)
+    {
+        if (!file.writeAt(patch.position, patch.times, patch.size))
+            return MovieWriteStatus::Failed;
+    }
+    if (keepFileTimes && !file.restoreTimes())
+        return MovieWriteStatus::Failed;
+    return MovieWriteStatus::Written;
+}
@@ -0,0 +1,39 @@
+#ifndef MP4_TIMES_H
+#define MP4_TIMES_H
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+
+/**
+ * Times from the movie header ('mvhd') box of an MP4 or QuickTime file.
+ */
+struct MovieHeader
+{
+    time_t creationTime = 0;     // creation_time, converted to seconds since 1970 (UTC)
+    time_t modificationTime = 0; // modification_time, or creationTime if unset
+    uint8_t version = 0;         // 0: 32-bit times, 1: 64-bit times
+    uint64_t position = 0;       // File offset of the version byte of the 'mvhd' payload
+};
+
+enum class MovieStatus
+{
+    Found,       // creation_time was read and is set
+    NoDate,      // An MP4/QuickTime file without a set creation_time
+    Unsupported, // Not an ISO base media file
+    Unreadable   // Could not be opened or read; lastMediaFileError() says why
+};
+
+enum class MovieWriteStatus
+{
+    Written,    // At least one header was updated
+    Unchanged,  // All headers already held the time
+    NotInPlace, // No 'mvhd' box, or a header that is damaged or whose 32-bit fields cannot hold the time
+    Failed      // Could not be opened, read or written; lastMediaFileError() says why
+};
+
+bool isVideoName(const std::filesystem::path &path);
+MovieStatus readMovieHeader(const std::filesystem::path &path, MovieHeader &header);
+MovieWriteStatus writeMovieTimes(const std::filesystem::path &path, time_t time, bool keepFileTimes);
+
+#endif
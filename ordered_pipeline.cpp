@@ -0,0 +1,298 @@
+#include "ordered_pipeline.h"
+#include "backoff.h"
+#include "error_log.h"
+#include "mp4_times.h"
+#include "progress.h"
+#include "run_stats.h"
+#include "sidecar.h"
+#include "trace.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+// Sidecars per batch. Large albums are split so one huge directory does not serialize the run.
+static const size_t maxBatchSize = 256;
+
+/**
+ * Resets a batch for reuse, keeping allocated capacity.
+ */
+void WorkBatch::clear()
+{
+    sidecars.clear();
+    videos.clear();
+    records.clear();
+    sidecarStatusCounts.fill(0);
+}
+
+/**
+ * Advances the directory walk, timing it as the walk phase.
+ * @param it The iterator.
+ * @param ec Receives any error.
+ */
+static void advance(fs::recursive_directory_iterator &it, std::error_code &ec)
+{
+    PhaseTimer timer(Phase::Walk);
+    it.increment(ec);
+}
+
+namespace
+{
+    /**
+     * The videos of one directory and the media file names its sidecars cover, gathered while the walk is
+     * in the directory.
+     */
+    struct DirectoryVideos
+    {
+        int depth;
+        fs::path directory;
+        std::vector<fs::path> videos;
+        std::unordered_set<std::string> covered; // Sidecar base names, and their stems for '.MP4' companions
+    };
+
+    /**
+     * Collects the videos of a finished directory that no sidecar describes, either directly or as the
+     * companion of a primary file (see findCompanions()).
+     */
+    void uncoveredVideos(DirectoryVideos &state, std::vector<fs::path> &videos)
+    {
+        for (auto &video : state.videos)
+        {
+            std::string extension = video.extension().string();
+            bool companion = (extension == ".MP4" || extension == ".mp4") && state.covered.count(video.stem().string());
+            if (!companion && !state.covered.count(video.filename().string()))
+                videos.push_back(std::move(video));
+        }
+    }
+}
+
+/**
+ * Walks a folder and hands sidecars to a callback in batches of the same directory.
+ * @param root The folder to walk.
+ * @param findVideos Also hand over, once the walk has left their directory, the videos no sidecar describes.
+ * @param emit Called with each full batch of sidecars or of videos; the vectors are cleared afterwards.
+ */
+static void walkBatches(const fs::path &root, bool findVideos,
+                        const std::function<void(std::vector<fs::path> &, std::vector<fs::path> &)> &emit)
+{
+    std::vector<fs::path> batch;
+    std::vector<fs::path> videos;
+    std::vector<fs::path> noSidecars;
+    // Directories the walk is still in, innermost last. Subdirectories are walked in the middle of their
+    // parent, so a directory is finished only when the walk returns to a shallower depth or a sibling.
+    std::vector<DirectoryVideos> open;
+    auto finishDirectories = [&](int depth, const fs::path &directory)
+    {
+        while (!open.empty() && (open.back().depth > depth || (open.back().depth == depth && open.back().directory != directory)))
+        {
+            uncoveredVideos(open.back(), videos);
+            open.pop_back();
+            if (!videos.empty())
+            {
+                emit(noSidecars, videos);
+                videos.clear();
+            }
+        }
+    };
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it, end;
+    {
+        PhaseTimer timer(Phase::Walk);
+        it = fs::recursive_directory_iterator(root, ec);
+    }
+    for (; !ec && it != end; advance(it, ec))
+    {
+        const fs::path &path = it->path();
+        if (statsEnabled())
+        {
+            std::error_code typeError;
+            countEvent(it->is_directory(typeError) ? Counter::DirectoriesRead : Counter::FilesSeen);
+        }
+        std::string filename = path.filename().string();
+        bool sidecar = isSidecarName(filename);
+        if (findVideos)
+        {
+            finishDirectories(it.depth(), path.parent_path());
+            if (sidecar || isVideoName(path))
+            {
+                if (open.empty() || open.back().depth != it.depth())
+                    open.push_back({it.depth(), path.parent_path(), {}, {}});
+                std::string baseName;
+                if (!sidecar)
+                    open.back().videos.push_back(path);
+                else if (sidecarBaseName(filename, baseName))
+                {
+                    open.back().covered.insert(fs::path(baseName).stem().string());
+                    open.back().covered.insert(std::move(baseName));
+                }
+            }
+        }
+        if (!sidecar)
+            continue;
+        if (!batch.empty() && (batch.size() == maxBatchSize || batch.back().parent_path() != path.parent_path()))
+        {
+            emit(batch, noSidecars);
+            batch.clear();
+        }
+        batch.push_back(path);
+    }
+    if (ec)
+        reportError(ErrorCode::ScanFailed, ec.value(), root.string(), ec.message());
+    if (!batch.empty())
+        emit(batch, noSidecars);
+    finishDirectories(-1, fs::path());
+}
+
+namespace
+{
+    enum SlotState
+    {
+        SlotEmpty,  // Free for the walker
+        SlotFilled, // Sidecars assigned, waiting for a worker
+        SlotDone    // Processed, waiting for the writer
+    };
+
+    /**
+     * Packs a batch sequence number and a slot state into one word, so a thread waiting for its batch
+     * never mistakes the previous lap of the slot for it.
+     */
+    uint64_t slotTurn(uint64_t sequence, SlotState state)
+    {
+        return sequence * 4 + state;
+    }
+
+    /**
+     * One entry of the reorder ring. Batch n always lives in slot n % ring size, so each slot has exactly
+     * one owner at a time (walker, worker, writer) and ownership is handed over through the turn alone:
+     * the batch is only touched after an acquire load has seen the owner's turn.
+     */
+    struct Slot
+    {
+        std::atomic<uint64_t> turn{0};
+        WorkBatch batch;
+    };
+}
+
+/**
+ * Processes one batch, traced as a span named after its directory, and counts it towards '--progress'.
+ */
+static void processBatch(const std::function<void(WorkBatch &)> &process, WorkBatch &batch)
+{
+    const fs::path &first = batch.sidecars.empty() ? batch.videos.front() : batch.sidecars.front();
+    TraceScope scope("batch", traceEnabled() ? first.parent_path().string() : std::string());
+    process(batch);
+    reportProgress(batch.sidecars.size());
+}
+
+/**
+ * Consumes one batch, traced as a span.
+ */
+static void consumeBatch(const std::function<void(WorkBatch &)> &consume, WorkBatch &batch)
+{
+    TraceScope scope("consume", std::string());
+    consume(batch);
+}
+
+/**
+ * Processes all sidecars under a folder and consumes the results in traversal order.
+ * With one job everything runs on the calling thread. Otherwise the calling thread walks the folder,
+ * 'jobs' workers process batches and a writer thread consumes them. Results go through a fixed ring of
+ * slots, so at most a few batches per worker are in memory and the writer flushes every contiguous
+ * completed batch without taking a lock.
+ * @param root The folder to walk.
+ * @param jobs Number of worker threads.
+ * @param findVideos Also make batches of the videos no sidecar describes (WorkBatch::videos).
+ * @param process Processes one batch; called concurrently from worker threads.
+ * @param consume Consumes one processed batch; always called from a single thread, in batch order.
+ */
+void runOrderedPipeline(const fs::path &root, unsigned jobs, bool findVideos,
+                        const std::function<void(WorkBatch &)> &process,
+                        const std::function<void(WorkBatch &)> &consume)
+{
+    if (jobs <= 1)
+    {
+        WorkBatch batch;
+        walkBatches(root, findVideos, [&](std::vector<fs::path> &sidecars, std::vector<fs::path> &videos)
+                    {
+            batch.clear();
+            batch.sidecars.swap(sidecars);
+            batch.videos.swap(videos);
+            processBatch(process, batch);
+            consumeBatch(consume, batch);
+            ++batch.sequence; });
+        return;
+    }
+
+    const size_t ringSize = jobs * 4;
+    std::unique_ptr<Slot[]> ring(new Slot[ringSize]);
+    for (size_t i = 0; i < ringSize; ++i)
+        ring[i].turn.store(slotTurn(i, SlotEmpty), std::memory_order_relaxed);
+    std::atomic<uint64_t> nextToClaim(0);
+    std::atomic<uint64_t> batchCount(UINT64_MAX); // Set once the walk is complete
+
+    auto worker = [&](unsigned index)
+    {
+        nameTraceThread("worker " + std::to_string(index + 1));
+        for (;;)
+        {
+            uint64_t sequence = nextToClaim.fetch_add(1);
+            Slot &slot = ring[sequence % ringSize];
+            Backoff backoff;
+            // The slot may still hold batch sequence - ringSize (or be empty) until the walker refills it.
+            while (slot.turn.load(std::memory_order_acquire) != slotTurn(sequence, SlotFilled))
+            {
+                if (sequence >= batchCount.load(std::memory_order_acquire))
+                    return;
+                backoff.pause();
+            }
+            processBatch(process, slot.batch);
+            slot.turn.store(slotTurn(sequence, SlotDone), std::memory_order_release);
+        }
+    };
+
+    auto writer = [&]()
+    {
+        nameTraceThread("consumer");
+        for (uint64_t sequence = 0;; ++sequence)
+        {
+            Slot &slot = ring[sequence % ringSize];
+            Backoff backoff;
+            while (slot.turn.load(std::memory_order_acquire) != slotTurn(sequence, SlotDone))
+            {
+                if (sequence >= batchCount.load(std::memory_order_acquire))
+                    return;
+                backoff.pause();
+            }
+            consumeBatch(consume, slot.batch);
+            slot.turn.store(slotTurn(sequence + ringSize, SlotEmpty), std::memory_order_release);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < jobs; ++i)
+        workers.emplace_back(worker, i);
+    std::thread writerThread(writer);
+
+    uint64_t produced = 0;
+    walkBatches(root, findVideos, [&](std::vector<fs::path> &sidecars, std::vector<fs::path> &videos)
+                {
+        Slot &slot = ring[produced % ringSize];
+        Backoff backoff;
+        while (slot.turn.load(std::memory_order_acquire) != slotTurn(produced, SlotEmpty))
+            backoff.pause();
+        slot.batch.clear();
+        slot.batch.sequence = produced;
+        slot.batch.sidecars.swap(sidecars);
+        slot.batch.videos.swap(videos);
+        slot.turn.store(slotTurn(produced++, SlotFilled), std::memory_order_release); });
+    batchCount.store(produced, std::memory_order_release);
+
+    for (auto &thread : workers)
+        thread.join();
+    writerThread.join();
+}
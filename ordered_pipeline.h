@@ -0,0 +1,32 @@
+#ifndef ORDERED_PIPELINE_H
+#define ORDERED_PIPELINE_H
+
+#include "sidecar.h"
+
+#include <array>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * A run of sidecars from one directory, plus everything processing them produced.
+ * Batches are numbered in traversal order and their results are consumed in that order.
+ */
+struct WorkBatch
+{
+    uint64_t sequence = 0;
+    std::vector<std::filesystem::path> sidecars;
+    std::vector<std::filesystem::path> videos; // Videos no sidecar describes; such batches have no sidecars
+
+    std::vector<MediaRecord> records; // Records of the sidecars, in sidecar order
+    std::array<size_t, static_cast<size_t>(SidecarStatus::Count)> sidecarStatusCounts{};
+
+    void clear();
+};
+
+void runOrderedPipeline(const std::filesystem::path &root, unsigned jobs, bool findVideos,
+                        const std::function<void(WorkBatch &)> &process,
+                        const std::function<void(WorkBatch &)> &consume);
+
+#endif
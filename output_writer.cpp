@@ -0,0 +1,252 @@
+#include "output_writer.h"
+#include "backoff.h"
+#include "run_stats.h"
+#include "trace.h"
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    /**
+     * A pre-formatted piece of output for one stream.
+     */
+    struct OutputChunk
+    {
+        OutputStream stream = OutputStream::Out;
+        std::string text;
+    };
+
+    /**
+     * Bounded lock-free multi-producer, single-consumer queue of output chunks.
+     * Each cell carries a sequence number that tells producers and the consumer whose turn it is
+     * (Vyukov's bounded queue), so producers only contend on one atomic increment per chunk.
+     */
+    class OutputRing
+    {
+    public:
+        OutputRing()
+        {
+            for (size_t i = 0; i < capacity; ++i)
+                cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        bool tryPush(OutputChunk &chunk)
+        {
+            size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+            Cell *cell;
+            for (;;)
+            {
+                cell = &cells_[pos & (capacity - 1)];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0)
+                {
+                    if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    return false; // Full
+                }
+                else
+                {
+                    pos = enqueuePos_.load(std::memory_order_relaxed);
+                }
+            }
+            cell->chunk = std::move(chunk);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(OutputChunk &chunk)
+        {
+            Cell &cell = cells_[dequeuePos_ & (capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence != dequeuePos_ + 1)
+                return false; // Empty, or the producer has not finished writing the cell
+            chunk = std::move(cell.chunk);
+            cell.sequence.store(dequeuePos_ + capacity, std::memory_order_release);
+            ++dequeuePos_;
+            return true;
+        }
+
+    private:
+        static const size_t capacity = 1024; // Power of two
+
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            OutputChunk chunk;
+        };
+
+        Cell cells_[capacity];
+        alignas(64) std::atomic<size_t> enqueuePos_{0};
+        alignas(64) size_t dequeuePos_ = 0; // Consumer only
+    };
+
+    OutputRing ring;
+    std::atomic<bool> writerRunning(false);
+    std::atomic<bool> stopRequested(false);
+    std::thread writerThread;
+    std::ostream *errorLogStream = nullptr;
+
+    // Hand a thread's error buffer off once it gets this large, even before the next flush point.
+    const size_t maxThreadBuffer = 64 * 1024;
+}
+
+/**
+ * Writes a chunk to its stream. Only the writer thread (or the caller, when no writer runs) does this.
+ * @param chunk The chunk to write.
+ */
+static void writeChunk(const OutputChunk &chunk)
+{
+    PhaseTimer timer(Phase::Output);
+    std::ostream *out = errorLogStream;
+    if (chunk.stream == OutputStream::Out)
+        out = &std::cout;
+    else if (chunk.stream == OutputStream::Err)
+        out = &std::cerr;
+    if (out)
+        out->write(chunk.text.data(), static_cast<std::streamsize>(chunk.text.size()));
+}
+
+/**
+ * Drains the ring until a stop is requested and the ring is empty.
+ */
+static void drainRing()
+{
+    nameTraceThread("output writer");
+    OutputChunk chunk;
+    Backoff backoff;
+    for (;;)
+    {
+        if (ring.tryPop(chunk))
+        {
+            writeChunk(chunk);
+            backoff.reset();
+            continue;
+        }
+        if (stopRequested.load(std::memory_order_acquire))
+        {
+            // Producers finished before the stop; pick up anything pushed in the meantime.
+            while (ring.tryPop(chunk))
+                writeChunk(chunk);
+            std::cout.flush();
+            if (errorLogStream)
+                errorLogStream->flush();
+            return;
+        }
+        backoff.pause();
+    }
+}
+
+/**
+ * Hands a whole chunk of output to the writer thread, or writes it directly if no writer is running.
+ * Blocks (with backoff) only while the ring is full, which bounds buffered output.
+ * @param stream The destination stream.
+ * @param text The pre-formatted text; complete lines, so chunks from different threads never interleave
+ *             within a line.
+ */
+void writeOutput(OutputStream stream, std::string text)
+{
+    if (text.empty())
+        return;
+    OutputChunk chunk{stream, std::move(text)};
+    if (!writerRunning.load(std::memory_order_acquire))
+    {
+        writeChunk(chunk);
+        return;
+    }
+    Backoff backoff;
+    while (!ring.tryPush(chunk))
+        backoff.pause();
+}
+
+/**
+ * Thread-local buffer for text produced while processing files.
+ * @param stream OutputStream::Err or OutputStream::ErrorLog.
+ */
+static std::ostringstream &threadBuffer(OutputStream stream)
+{
+    thread_local std::ostringstream errBuffer;
+    thread_local std::ostringstream logBuffer;
+    return stream == OutputStream::ErrorLog ? logBuffer : errBuffer;
+}
+
+/**
+ * Returns this thread's buffer for a stream. Text is handed to the writer by flushThreadOutput(),
+ * so per-file code never writes or flushes std::cerr or the error log itself.
+ * Terminate lines with '\n' rather than std::endl.
+ * @param stream OutputStream::Err or OutputStream::ErrorLog.
+ * @return The thread-local stream.
+ */
+std::ostream &threadStream(OutputStream stream)
+{
+    std::ostringstream &buffer = threadBuffer(stream);
+    if (static_cast<size_t>(buffer.tellp()) > maxThreadBuffer)
+        flushThreadOutput();
+    return buffer;
+}
+
+/**
+ * Returns this thread's error stream (see threadStream()).
+ * @return The thread-local error stream.
+ */
+std::ostream &threadErr()
+{
+    return threadStream(OutputStream::Err);
+}
+
+/**
+ * Hands this thread's buffered error and error log text to the writer, one chunk per stream.
+ */
+void flushThreadOutput()
+{
+    for (OutputStream stream : {OutputStream::Err, OutputStream::ErrorLog})
+    {
+        std::ostringstream &buffer = threadBuffer(stream);
+        if (buffer.tellp() <= 0)
+            continue;
+        writeOutput(stream, buffer.str());
+        buffer.str(std::string());
+    }
+}
+
+/**
+ * Sets the destination of OutputStream::ErrorLog chunks; without one they are discarded.
+ * Must be called while the writer is not running.
+ * @param out The log stream, or nullptr.
+ */
+void setErrorLogStream(std::ostream *out)
+{
+    errorLogStream = out;
+}
+
+/**
+ * Starts the writer thread that drains output chunks to std::cout, std::cerr and the error log.
+ * While it runs, no other thread may write std::cout or std::cerr directly.
+ */
+void startOutputWriter()
+{
+    std::cout.flush();
+    stopRequested = false;
+    writerRunning = true;
+    writerThread = std::thread(drainRing);
+}
+
+/**
+ * Flushes the calling thread's buffer, waits until all queued chunks are written and stops the writer.
+ * Other producer threads must have flushed and finished before this is called.
+ */
+void stopOutputWriter()
+{
+    flushThreadOutput();
+    if (!writerRunning)
+        return;
+    stopRequested.store(true, std::memory_order_release);
+    writerThread.join();
+    writerRunning = false;
+}
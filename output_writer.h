@@ -0,0 +1,22 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <ostream>
+#include <string>
+
+enum class OutputStream
+{
+    Out,
+    Err,
+    ErrorLog
+};
+
+std::ostream &threadStream(OutputStream stream);
+std::ostream &threadErr();
+void flushThreadOutput();
+void writeOutput(OutputStream stream, std::string text);
+void setErrorLogStream(std::ostream *out);
+void startOutputWriter();
+void stopOutputWriter();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef PROCESS_STATS_H
+#define PROCESS_STATS_H
+
+#include <cstddef>
+
+size_t peakResidentSetBytes();
+
+#endif
@@ -0,0 +1,160 @@
+#include "progress.h"
+#include "output_writer.h"
+#include "sidecar.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    std::atomic<bool> enabled(false);
+    std::atomic<uint64_t> sidecarsDone(0);
+    std::atomic<uint64_t> bytesDone(0);
+    std::atomic<uint64_t> sidecarsCounted(0);
+    std::atomic<bool> countFinished(false);
+    std::atomic<bool> countStopRequested(false);
+
+    thread_local uint64_t pendingBytes = 0; // Bytes read by this thread since its last reportProgress()
+
+    std::thread countThread;
+    std::thread reportThread;
+    std::mutex reportMutex;
+    std::condition_variable reportWake;
+    bool reportStopRequested = false;
+    std::chrono::steady_clock::time_point startTime;
+}
+
+/**
+ * Counts the sidecars under a folder from directory entries alone (no stat or open per file), so it
+ * finishes long before the real work and gives the ETA a total.
+ * @param root The folder to count.
+ */
+static void countSidecars(const fs::path &root)
+{
+    std::error_code ec;
+    uint64_t count = 0;
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if (countStopRequested.load(std::memory_order_relaxed))
+            return;
+        if (isSidecarName(it->path().filename().string()) && ++count % 1024 == 0)
+            sidecarsCounted.store(count, std::memory_order_relaxed);
+    }
+    sidecarsCounted.store(count, std::memory_order_relaxed);
+    countFinished.store(true, std::memory_order_release);
+}
+
+/**
+ * Formats the current progress line.
+ * @return E.g. "1200/5000 sidecars (24%), 850 files/s, 0.4 MB/s, ETA 0:04".
+ */
+static std::string progressLine()
+{
+    uint64_t done = sidecarsDone.load(std::memory_order_relaxed);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double rate = seconds > 0 ? done / seconds : 0;
+    double megabytesPerSecond = seconds > 0 ? bytesDone.load(std::memory_order_relaxed) / seconds / (1024 * 1024) : 0;
+    bool totalKnown = countFinished.load(std::memory_order_acquire);
+    uint64_t total = sidecarsCounted.load(std::memory_order_relaxed);
+
+    char line[160];
+    int length;
+    if (totalKnown && total > 0)
+        length = std::snprintf(line, sizeof(line), "%llu/%llu sidecars (%d%%)", static_cast<unsigned long long>(done),
+                               static_cast<unsigned long long>(total), static_cast<int>(done * 100 / total));
+    else
+        length = std::snprintf(line, sizeof(line), "%llu/%llu+ sidecars", static_cast<unsigned long long>(done),
+                               static_cast<unsigned long long>(total));
+    length += std::snprintf(line + length, sizeof(line) - length, ", %.0f files/s, %.1f MB/s", rate, megabytesPerSecond);
+    if (totalKnown && rate > 0 && total >= done)
+    {
+        unsigned long long eta = static_cast<unsigned long long>((total - done) / rate);
+        std::snprintf(line + length, sizeof(line) - length, ", ETA %llu:%02llu:%02llu", eta / 3600, eta / 60 % 60, eta % 60);
+    }
+    return line;
+}
+
+/**
+ * Starts the pre-count and a reporter that prints a progress line on stderr. On a terminal the line is
+ * redrawn four times a second; otherwise (e.g. when logging to a file) a full line is printed every 10 seconds.
+ * @param root The folder being processed.
+ */
+void startProgress(const fs::path &root)
+{
+    startTime = std::chrono::steady_clock::now();
+    enabled = true;
+    countStopRequested = false;
+    countThread = std::thread(countSidecars, root);
+
+#ifdef _WIN32
+    bool terminal = _isatty(_fileno(stderr)) != 0;
+#else
+    bool terminal = isatty(fileno(stderr)) != 0;
+#endif
+    reportStopRequested = false;
+    reportThread = std::thread([terminal]()
+                               {
+        auto interval = terminal ? std::chrono::milliseconds(250) : std::chrono::milliseconds(10000);
+        std::unique_lock<std::mutex> lock(reportMutex);
+        while (!reportWake.wait_for(lock, interval, []
+                                    { return reportStopRequested; }))
+        {
+            // "\33[K" clears the rest of the terminal line in case the previous update was longer
+            writeOutput(OutputStream::Err, terminal ? "\r" + progressLine() + "\33[K" : progressLine() + "\n");
+        }
+        writeOutput(OutputStream::Err, (terminal ? "\r" : "") + progressLine() + (terminal ? "\33[K\n" : "\n")); });
+}
+
+/**
+ * Stops the reporter after printing a final line, and abandons the pre-count if it is still running.
+ */
+void stopProgress()
+{
+    if (!reportThread.joinable())
+        return;
+    countStopRequested = true;
+    {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        reportStopRequested = true;
+    }
+    reportWake.notify_all();
+    reportThread.join();
+    countThread.join();
+    enabled = false;
+}
+
+/**
+ * Notes bytes read by the calling thread. Kept thread-local until the next reportProgress(), so the
+ * per-file path touches no shared state.
+ * @param bytes Number of bytes read.
+ */
+void addProgressBytes(uint64_t bytes)
+{
+    pendingBytes += bytes;
+}
+
+/**
+ * Publishes a finished batch of sidecars together with the bytes the calling thread read for it.
+ * @param sidecars Number of sidecars in the batch.
+ */
+void reportProgress(uint64_t sidecars)
+{
+    if (!enabled.load(std::memory_order_relaxed))
+        return;
+    sidecarsDone.fetch_add(sidecars, std::memory_order_relaxed);
+    bytesDone.fetch_add(pendingBytes, std::memory_order_relaxed);
+    pendingBytes = 0;
+}
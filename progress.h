@@ -0,0 +1,12 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <cstdint>
+#include <filesystem>
+
+void startProgress(const std::filesystem::path &root);
+void stopProgress();
+void addProgressBytes(uint64_t bytes);
+void reportProgress(uint64_t sidecars);
+
+#endif
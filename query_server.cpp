@@ -0,0 +1,332 @@
+#include "query_server.h"
+#include "format.h"
+#include "metadata_index.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Current snapshot. Readers take a reference with std::atomic_load and keep using it even if the
+// reload thread publishes a newer one, so queries never wait on a rebuild or on each other.
+static std::shared_ptr<const MetadataIndex> currentIndex;
+static std::atomic<bool> stopRequested(false);
+
+// Longest query line accepted; a client that sends more without a newline is disconnected
+static const size_t maxQueryLineBytes = 64 * 1024;
+
+// Milliseconds between checks for a stop request while waiting on a socket
+static const int pollIntervalMs = 200;
+
+// Seconds a response may wait for a client that stopped reading, so shutdown never waits on it forever
+static const int sendTimeoutSeconds = 5;
+
+/**
+ * A client connection's thread. done is set when it returns, so the accept loop can join it.
+ */
+struct ClientThread
+{
+    std::thread thread;
+    std::atomic<bool> done{false};
+};
+
+static void requestStop(int)
+{
+    stopRequested = true;
+}
+
+/**
+ * Parses a decimal Unix timestamp.
+ * @param text The text to parse.
+ * @param value Receives the timestamp.
+ * @return True if the whole text is a valid integer.
+ */
+static bool parseTimestamp(const std::string &text, time_t &value)
+{
+    if (text.empty())
+        return false;
+    char *end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0')
+        return false;
+    value = static_cast<time_t>(parsed);
+    return true;
+}
+
+/**
+ * Answers one query line against a snapshot.
+ * Every response ends with an empty line: CSV rows in '--list' format, a count, or a single "ERR ..." line.
+ * @param index The snapshot to query.
+ * @param line The query, without the trailing newline.
+ * @param out Receives the response.
+ */
+static void answerQuery(const MetadataIndex &index, const std::string &line, std::string &out)
+{
+    std::string command = line.substr(0, line.find(' '));
+    std::string argument = line.size() > command.size() ? line.substr(command.size() + 1) : std::string();
+
+    if (command == "GET")
+    {
+        if (const MediaRecord *record = index.find(argument))
+            appendListRow(out, record->path, record->photoTakenTime, record->creationTime, record->peopleNames);
+    }
+    else if (command == "RANGE")
+    {
+        // RANGE <from> <to> [person]
+        std::istringstream args(argument);
+        std::string fromText, toText, person;
+        args >> fromText >> toText;
+        std::getline(args >> std::ws, person);
+        time_t from, to;
+        if (!parseTimestamp(fromText, from) || !parseTimestamp(toText, to))
+        {
+            out += "ERR usage: RANGE <from> <to> [person]\n\n";
+            return;
+        }
+        for (const MediaRecord *record : index.range(from, to, person))
+            appendListRow(out, record->path, record->photoTakenTime, record->creationTime, record->peopleNames);
+    }
+    else if (command == "PERSON")
+    {
+        for (const MediaRecord *record : index.withPerson(argument))
+            appendListRow(out, record->path, record->photoTakenTime, record->creationTime, record->peopleNames);
+    }
+    else if (command == "COUNT")
+    {
+        out += std::to_string(index.size());
+        out += '\n';
+    }
+    else
+    {
+        out += "ERR unknown command: " + command + "\n\n";
+        return;
+    }
+    out += '\n';
+}
+
+/**
+ * Writes a whole buffer to a socket.
+ * @param fd The socket.
+ * @param data The bytes to send.
+ * @return True if everything was written.
+ */
+static bool writeAll(int fd, const std::string &data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * Serves one client connection until it disconnects, sends QUIT, sends a line longer than
+ * maxQueryLineBytes, or the server stops.
+ * Each line is one query; a client may pipeline any number of queries on a connection.
+ * @param fd The connected socket; closed on return.
+ * @param done Set on return.
+ */
+static void serveClient(int fd, std::atomic<bool> &done)
+{
+    std::string pending;
+    std::string response;
+    char buffer[4096];
+    while (!stopRequested)
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, pollIntervalMs);
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready <= 0)
+            continue;
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        pending.append(buffer, static_cast<size_t>(n));
+
+        response.clear();
+        std::shared_ptr<const MetadataIndex> index = std::atomic_load(&currentIndex);
+        size_t lineStart = 0;
+        bool quit = false;
+        for (size_t newline; (newline = pending.find('\n', lineStart)) != std::string::npos; lineStart = newline + 1)
+        {
+            std::string line = pending.substr(lineStart, newline - lineStart);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line == "QUIT")
+            {
+                quit = true;
+                break;
+            }
+            answerQuery(*index, line, response);
+        }
+        pending.erase(0, lineStart);
+        if (!quit && pending.size() > maxQueryLineBytes)
+        {
+            response += "ERR query line too long\n\n";
+            quit = true;
+        }
+        if ((!response.empty() && !writeAll(fd, response)) || quit)
+            break;
+    }
+    ::close(fd);
+    done = true;
+}
+
+/**
+ * Removes a stale socket file. Anything else at the path is left alone.
+ * @param socketPath Filesystem path of the socket.
+ * @return False if the path exists and is not a socket, or cannot be removed (errno says why).
+ */
+static bool removeSocketFile(const std::string &socketPath)
+{
+    struct stat info;
+    if (::lstat(socketPath.c_str(), &info) != 0)
+        return errno == ENOENT;
+    if (!S_ISSOCK(info.st_mode))
+    {
+        errno = EEXIST;
+        return false;
+    }
+    return ::unlink(socketPath.c_str()) == 0 || errno == ENOENT;
+}
+
+/**
+ * Joins the client threads that have returned.
+ * @param clients The running and finished client threads.
+ */
+static void joinFinishedClients(std::list<ClientThread> &clients)
+{
+    for (auto it = clients.begin(); it != clients.end();)
+    {
+        if (!it->done)
+        {
+            ++it;
+            continue;
+        }
+        it->thread.join();
+        it = clients.erase(it);
+    }
+}
+
+/**
+ * Runs the query daemon: indexes a folder, then answers queries on a Unix domain socket until
+ * SIGINT or SIGTERM. The index is rebuilt incrementally in the background when sidecars change.
+ * @param root The folder to index.
+ * @param socketPath Filesystem path of the socket to listen on; a stale socket is replaced, but any other
+ *                   file there is an error.
+ * @param reloadIntervalSeconds Seconds between rescans for changed sidecars, or 0 to never rescan.
+ * @return 0 on clean shutdown, 1 on error.
+ */
+int runQueryServer(const fs::path &root, const std::string &socketPath, int reloadIntervalSeconds)
+{
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return 1;
+    }
+
+    MetadataIndexBuilder builder(root);
+    size_t changed = 0;
+    std::atomic_store(&currentIndex, builder.rescan(changed));
+    std::cerr << "Indexed " << currentIndex->size() << " files from " << changed << " sidecars" << std::endl;
+
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd == -1)
+    {
+        std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (!removeSocketFile(socketPath))
+    {
+        std::cerr << "Not replacing " << socketPath << ": " << (errno == EEXIST ? "not a socket" : strerror(errno))
+                  << std::endl;
+        ::close(listenFd);
+        return 1;
+    }
+    if (::bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd, SOMAXCONN) != 0)
+    {
+        std::cerr << "Failed to listen on " << socketPath << ": " << strerror(errno) << std::endl;
+        ::close(listenFd);
+        return 1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    std::thread reloader;
+    if (reloadIntervalSeconds > 0)
+    {
+        reloader = std::thread([&builder, reloadIntervalSeconds]()
+                               {
+            auto nextScan = std::chrono::steady_clock::now() + std::chrono::seconds(reloadIntervalSeconds);
+            while (!stopRequested)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                if (std::chrono::steady_clock::now() < nextScan)
+                    continue;
+                size_t changedSidecars = 0;
+                auto index = builder.rescan(changedSidecars);
+                if (changedSidecars > 0)
+                    std::atomic_store(&currentIndex, std::shared_ptr<const MetadataIndex>(std::move(index)));
+                nextScan = std::chrono::steady_clock::now() + std::chrono::seconds(reloadIntervalSeconds);
+            } });
+    }
+
+    std::cerr << "Listening on " << socketPath << std::endl;
+    std::list<ClientThread> clients;
+    while (!stopRequested)
+    {
+        joinFinishedClients(clients);
+        pollfd pfd{listenFd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, pollIntervalMs);
+        if (ready <= 0)
+            continue;
+        int clientFd = ::accept(listenFd, nullptr, nullptr);
+        if (clientFd == -1)
+            continue;
+        timeval sendTimeout{sendTimeoutSeconds, 0};
+        ::setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+        clients.emplace_back();
+        ClientThread &client = clients.back();
+        client.thread = std::thread(serveClient, clientFd, std::ref(client.done));
+    }
+
+    // Clients notice the stop request within a poll interval; none may outlive the index
+    for (ClientThread &client : clients)
+        client.thread.join();
+    if (reloader.joinable())
+        reloader.join();
+    ::close(listenFd);
+    removeSocketFile(socketPath);
+    return 0;
+}
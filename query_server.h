@@ -0,0 +1,9 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <filesystem>
+#include <string>
+
+int runQueryServer(const std::filesystem::path &root, const std::string &socketPath, int reloadIntervalSeconds);
+
+#endif
@@ -0,0 +1,204 @@
+#include "row_sorter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+/**
+ * Parses the argument of '--sort'.
+ * @param text One of "taken", "uploaded" or "path".
+ * @param key Receives the sort key.
+ * @return True if the text names a sort key.
+ */
+bool parseSortKey(const std::string &text, SortKey &key)
+{
+    if (text == "taken")
+        key = SortKey::Taken;
+    else if (text == "uploaded")
+        key = SortKey::Uploaded;
+    else if (text == "path")
+        key = SortKey::Path;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * Maps a signed timestamp to an unsigned value with the same ordering.
+ * @param time The timestamp.
+ * @return The biased key.
+ */
+static uint64_t timeKey(time_t time)
+{
+    return static_cast<uint64_t>(static_cast<int64_t>(time)) ^ (uint64_t(1) << 63);
+}
+
+/**
+ * Packs the first 8 bytes of a string big-endian, zero-padded, so integer order matches byte order.
+ * @param data The string bytes.
+ * @param length The string length.
+ * @return The prefix key.
+ */
+static uint64_t prefixKey(const char *data, size_t length)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; ++i)
+        key = (key << 8) | (i < length ? static_cast<unsigned char>(data[i]) : 0);
+    return key;
+}
+
+/**
+ * Appends a 64-bit value big-endian, so byte order matches integer order in run files.
+ * @param out The buffer to append to.
+ * @param value The value.
+ */
+static void appendBigEndian(std::string &out, uint64_t value)
+{
+    for (int shift = 56; shift >= 0; shift -= 8)
+        out += static_cast<char>((value >> shift) & 0xff);
+}
+
+/**
+ * @param key The column to sort by.
+ * @param memoryBudget Bytes of arena and row references to hold before spilling a sorted run.
+ * @param rowWriter Formats the rows; it must outlive the sorter.
+ */
+RowSorter::RowSorter(SortKey key, size_t memoryBudget, const ListRowWriter &rowWriter)
+    : key_(key), memoryBudget_(memoryBudget), rowWriter_(rowWriter), runs_(memoryBudget, false)
+{
+}
+
+/**
+ * Formats a row into the arena and records a reference to it.
+ * @param record The media file and its metadata.
+ */
+void RowSorter::add(const MediaRecord &record)
+{
+    if (failed_)
+        return;
+    const std::string &path = record.path;
+    RowRef row;
+    row.offset = static_cast<uint32_t>(arena_.size());
+    row.pathLength = key_ == SortKey::Path ? static_cast<uint32_t>(path.size()) : 0;
+    if (key_ == SortKey::Path)
+    {
+        row.key = prefixKey(path.data(), path.size());
+        arena_ += path;
+    }
+    else
+    {
+        row.key = timeKey(key_ == SortKey::Taken ? record.photoTakenTime : record.creationTime);
+    }
+    size_t rowStart = arena_.size();
+    rowWriter_.appendRow(arena_, record);
+    row.rowLength = static_cast<uint32_t>(arena_.size() - rowStart);
+    rows_.push_back(row);
+
+    // Offsets are 32-bit, so the arena is also capped at 2 GB regardless of the budget; rows cannot stay
+    // in memory past that, so a failed spill ends the sort.
+    size_t used = arena_.capacity() + rows_.capacity() * sizeof(RowRef);
+    if ((used > memoryBudget_ || arena_.size() > std::numeric_limits<uint32_t>::max() / 2) && !spill())
+        fail();
+}
+
+/**
+ * Reports a failed spill once and drops the buffered rows.
+ */
+void RowSorter::fail()
+{
+    reportSpillFailed("--sort cannot complete");
+    failed_ = true;
+    std::string().swap(arena_);
+    std::vector<RowRef>().swap(rows_);
+}
+
+/**
+ * Orders two row references; ties fall back to arena position, which keeps the sort stable.
+ */
+bool RowSorter::less(const RowRef &a, const RowRef &b) const
+{
+    if (a.key != b.key)
+        return a.key < b.key;
+    if (key_ == SortKey::Path)
+    {
+        int cmp = std::memcmp(arena_.data() + a.offset, arena_.data() + b.offset, std::min(a.pathLength, b.pathLength));
+        if (cmp != 0)
+            return cmp < 0;
+        if (a.pathLength != b.pathLength)
+            return a.pathLength < b.pathLength;
+    }
+    return a.offset < b.offset;
+}
+
+/**
+ * Sorts the in-memory row references.
+ */
+void RowSorter::sortRows()
+{
+    std::sort(rows_.begin(), rows_.end(), [this](const RowRef &a, const RowRef &b)
+              { return less(a, b); });
+}
+
+/**
+ * Sorts the buffered rows and writes them as one run of byte-comparable records:
+ * the sort key, then a sequence number for stability, then the CSV row.
+ * @return True on success; on failure the rows stay in memory.
+ */
+bool RowSorter::spill()
+{
+    sortRows();
+    size_t next = 0;
+    bool ok = runs_.addSortedRun([this, &next](std::string &record)
+                                 {
+        if (next == rows_.size())
+            return false;
+        const RowRef &row = rows_[next++];
+        record.clear();
+        if (key_ == SortKey::Path)
+        {
+            record.append(arena_, row.offset, row.pathLength);
+            record += '\0';
+        }
+        else
+        {
+            appendBigEndian(record, row.key);
+        }
+        appendBigEndian(record, (static_cast<uint64_t>(runNumber_) << 32) | row.offset);
+        record.append(arena_, row.offset + row.pathLength, row.rowLength);
+        return true; });
+    if (!ok)
+        return false;
+
+    ++runNumber_;
+    std::string().swap(arena_);
+    std::vector<RowRef>().swap(rows_);
+    return true;
+}
+
+/**
+ * Writes all rows in sorted order.
+ * @param out The stream to write to.
+ * @return True on success, false if rows could not be spilled or read back.
+ */
+bool RowSorter::writeTo(std::ostream &out)
+{
+    if (failed_)
+        return false;
+    if (runs_.runCount() == 0)
+    {
+        sortRows();
+        for (const RowRef &row : rows_)
+            out.write(arena_.data() + row.offset + row.pathLength, row.rowLength);
+        return true;
+    }
+
+    if (!rows_.empty() && !spill())
+    {
+        fail();
+        return false;
+    }
+    return runs_.forEach([this, &out](const std::string &record)
+                         {
+        size_t rowStart = key_ == SortKey::Path ? record.find('\0') + 1 + 8 : 16;
+        out.write(record.data() + rowStart, record.size() - rowStart); });
+}
@@ -0,0 +1,61 @@
+#ifndef ROW_SORTER_H
+#define ROW_SORTER_H
+
+#include "external_sort.h"
+#include "list_columns.h"
+
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class SortKey
+{
+    Taken,
+    Uploaded,
+    Path
+};
+
+bool parseSortKey(const std::string &text, SortKey &key);
+
+/**
+ * Collects '--list' rows and writes them ordered by a sort key.
+ * Formatted rows live in one arena and are sorted through small fixed-width references; rows that do not
+ * fit the memory budget are spilled as sorted runs and merged on output. Equal keys keep their input order.
+ * If a run cannot be written, the sort fails: later rows are dropped and writeTo() returns false.
+ */
+class RowSorter
+{
+public:
+    RowSorter(SortKey key, size_t memoryBudget, const ListRowWriter &rowWriter);
+
+    void add(const MediaRecord &record);
+    bool writeTo(std::ostream &out);
+    size_t runCount() const { return runs_.runCount(); }
+
+private:
+    struct RowRef
+    {
+        uint64_t key;        // Sort time (biased to unsigned) or the first 8 path bytes, big-endian
+        uint32_t offset;     // Start of the row in the arena (path bytes, then the CSV row)
+        uint32_t pathLength; // Only used for SortKey::Path
+        uint32_t rowLength;
+    };
+
+    bool less(const RowRef &a, const RowRef &b) const;
+    void sortRows();
+    bool spill();
+    void fail();
+
+    SortKey key_;
+    size_t memoryBudget_;
+    const ListRowWriter &rowWriter_;
+    uint32_t runNumber_ = 0;
+    bool failed_ = false;
+    std::string arena_;
+    std::vector<RowRef> rows_;
+    ExternalSorter runs_;
+};
+
+#endif
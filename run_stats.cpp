@@ -0,0 +1,283 @@
+#include "run_stats.h"
+#include "error_log.h"
+#include "process_stats.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    const char *phaseNames[] = {"walk", "read", "parse", "resolve", "apply", "output"};
+    const char *counterNames[] = {"files_seen", "directories_read", "sidecars_parsed", "companions_matched",
+                                  "bytes_read", "stat_calls", "open_calls", "read_calls", "write_calls", "close_calls",
+                                  "set_times_calls", "set_creation_time_calls", "tag_calls", "exif_dates_written",
+                                  "video_dates_written"};
+    static_assert(sizeof(phaseNames) / sizeof(phaseNames[0]) == static_cast<size_t>(Phase::Count),
+                  "phaseNames must list every Phase");
+    static_assert(sizeof(counterNames) / sizeof(counterNames[0]) == static_cast<size_t>(Counter::Count),
+                  "counterNames must list every Counter");
+
+    // Thread CPU time needs a real system call on most platforms, so only every Nth timed scope samples it;
+    // the CPU time of a phase is extrapolated from its sampled share of wall time.
+    const unsigned cpuSampleInterval = 16;
+
+    /**
+     * Counters of one thread. Only the owning thread writes them; they are relaxed atomics (plain loads and
+     * stores, no read-modify-write) so '--metrics-file' can read them while the run continues.
+     */
+    struct ThreadStats
+    {
+        std::atomic<int64_t> wallNs[static_cast<size_t>(Phase::Count)] = {};
+        std::atomic<int64_t> sampledWallNs[static_cast<size_t>(Phase::Count)] = {};
+        std::atomic<int64_t> sampledCpuNs[static_cast<size_t>(Phase::Count)] = {};
+        std::atomic<uint64_t> counters[static_cast<size_t>(Counter::Count)] = {};
+        unsigned timerCount = 0;
+    };
+
+    /**
+     * Adds to a counter that only the calling thread writes.
+     */
+    template <typename T>
+    void addOwned(std::atomic<T> &counter, T amount)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> enabled(false);
+    std::mutex registryMutex; // Only taken once per thread, when it first records something
+    std::vector<std::unique_ptr<ThreadStats>> registry;
+
+    /**
+     * Totals over all threads.
+     */
+    struct MergedStats
+    {
+        double wallSeconds[static_cast<size_t>(Phase::Count)] = {};
+        double cpuSeconds[static_cast<size_t>(Phase::Count)] = {};
+        uint64_t counters[static_cast<size_t>(Counter::Count)] = {};
+    };
+}
+
+/**
+ * Returns the calling thread's counters, registering them on first use.
+ */
+static ThreadStats &threadStats()
+{
+    thread_local ThreadStats *stats = nullptr;
+    if (!stats)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.emplace_back(new ThreadStats());
+        stats = registry.back().get();
+    }
+    return *stats;
+}
+
+/**
+ * @return Monotonic wall clock in nanoseconds.
+ */
+static int64_t wallNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @return CPU time consumed by the calling thread in nanoseconds, or 0 if unavailable.
+ */
+static int64_t threadCpuNow()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+    return 0;
+}
+
+/**
+ * Turns on phase timing and counters for this run. Tracing turns this on too, since phase timers feed the trace.
+ */
+void enableStats()
+{
+    enabled = true;
+}
+
+/**
+ * @return True if '--stats' or '--stats-json' is active.
+ */
+bool statsEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Adds to one of the calling thread's counters.
+ * @param counter The counter.
+ * @param amount The amount to add.
+ */
+void countEvent(Counter counter, uint64_t amount)
+{
+    if (statsEnabled())
+        addOwned(threadStats().counters[static_cast<size_t>(counter)], amount);
+}
+
+/**
+ * Starts timing a scope.
+ * @param phase The phase the scope belongs to.
+ */
+PhaseTimer::PhaseTimer(Phase phase) : phase_(phase)
+{
+    if (!statsEnabled())
+        return;
+    active_ = true;
+    sampleCpu_ = threadStats().timerCount++ % cpuSampleInterval == 0;
+    if (sampleCpu_)
+        cpuStart_ = threadCpuNow();
+    wallStart_ = wallNow();
+}
+
+/**
+ * Adds the elapsed time to the phase.
+ */
+PhaseTimer::~PhaseTimer()
+{
+    if (!active_)
+        return;
+    int64_t wall = wallNow() - wallStart_;
+    ThreadStats &stats = threadStats();
+    size_t index = static_cast<size_t>(phase_);
+    addOwned(stats.wallNs[index], wall);
+    if (sampleCpu_)
+    {
+        addOwned(stats.sampledWallNs[index], wall);
+        addOwned(stats.sampledCpuNs[index], threadCpuNow() - cpuStart_);
+    }
+    traceSpan(phaseNames[index], wallStart_, wall);
+}
+
+/**
+ * Sums the counters of all threads. While the run continues this is a recent, not exact, snapshot.
+ * @return The merged totals.
+ */
+static MergedStats mergeStats()
+{
+    MergedStats merged;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    int64_t sampledWall[static_cast<size_t>(Phase::Count)] = {};
+    int64_t sampledCpu[static_cast<size_t>(Phase::Count)] = {};
+    for (const auto &stats : registry)
+    {
+        for (size_t i = 0; i < static_cast<size_t>(Phase::Count); ++i)
+        {
+            merged.wallSeconds[i] += stats->wallNs[i].load(std::memory_order_relaxed) / 1e9;
+            sampledWall[i] += stats->sampledWallNs[i].load(std::memory_order_relaxed);
+            sampledCpu[i] += stats->sampledCpuNs[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < static_cast<size_t>(Counter::Count); ++i)
+            merged.counters[i] += stats->counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < static_cast<size_t>(Phase::Count); ++i)
+    {
+        // A thread cannot use more CPU than wall time; clamp the clock-granularity noise of short scopes
+        if (sampledWall[i] > 0)
+            merged.cpuSeconds[i] = merged.wallSeconds[i] * std::min(1.0, static_cast<double>(sampledCpu[i]) / sampledWall[i]);
+    }
+    return merged;
+}
+
+/**
+ * Prints phase times and counters as a table.
+ * Phase times are summed over threads, so with '--jobs' they can exceed the run's wall time.
+ * @param out The stream to print to.
+ * @param wallSeconds Wall time of the whole run.
+ */
+void printStats(std::ostream &out, double wallSeconds)
+{
+    MergedStats merged = mergeStats();
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "Run time: " << wallSeconds << " s, peak RSS: " << peakResidentSetBytes() / (1024 * 1024) << " MB\n";
+    out << std::left << std::setw(10) << "Phase" << std::right << std::setw(12) << "Wall (s)" << std::setw(12) << "CPU (s)" << "\n";
+    for (size_t i = 0; i < static_cast<size_t>(Phase::Count); ++i)
+    {
+        out << std::left << std::setw(10) << phaseNames[i] << std::right << std::setw(12) << merged.wallSeconds[i]
+            << std::setw(12) << merged.cpuSeconds[i] << "\n";
+    }
+    for (size_t i = 0; i < static_cast<size_t>(Counter::Count); ++i)
+        out << std::left << std::setw(25) << counterNames[i] << std::right << merged.counters[i] << "\n";
+    out << std::left << std::setw(25) << "errors" << std::right << totalErrorCount() << "\n";
+    out.flags(flags);
+}
+
+/**
+ * Writes phase times and counters as a JSON object.
+ * @param out The stream to write to.
+ * @param wallSeconds Wall time of the whole run.
+ */
+void writeStatsJSON(std::ostream &out, double wallSeconds)
+{
+    MergedStats merged = mergeStats();
+    out << "{\"wall_seconds\":" << wallSeconds << ",\"peak_rss_bytes\":" << peakResidentSetBytes() << ",\"phases\":{";
+    for (size_t i = 0; i < static_cast<size_t>(Phase::Count); ++i)
+    {
+        out << (i ? "," : "") << "\"" << phaseNames[i] << "\":{\"wall_seconds\":" << merged.wallSeconds[i]
+            << ",\"cpu_seconds\":" << merged.cpuSeconds[i] << "}";
+    }
+    out << "},\"counters\":{";
+    for (size_t i = 0; i < static_cast<size_t>(Counter::Count); ++i)
+        out << (i ? "," : "") << "\"" << counterNames[i] << "\":" << merged.counters[i];
+    out << ",\"errors\":" << totalErrorCount() << "}}\n";
+}
+
+/**
+ * Writes phase times, counters, errors by class and peak RSS in the Prometheus text exposition format.
+ * @param out The stream to write to.
+ * @param wallSeconds Wall time of the run so far.
+ * @param complete True once the run has finished.
+ */
+void writeStatsPrometheus(std::ostream &out, double wallSeconds, bool complete)
+{
+    MergedStats merged = mergeStats();
+    out << "# HELP takeout_run_complete Whether the run has finished.\n"
+        << "# TYPE takeout_run_complete gauge\n"
+        << "takeout_run_complete " << (complete ? 1 : 0) << "\n"
+        << "# HELP takeout_last_update_timestamp_seconds When this file was written.\n"
+        << "# TYPE takeout_last_update_timestamp_seconds gauge\n"
+        << "takeout_last_update_timestamp_seconds " << static_cast<long long>(std::time(nullptr)) << "\n"
+        << "# HELP takeout_run_duration_seconds Wall time since the run started.\n"
+        << "# TYPE takeout_run_duration_seconds gauge\n"
+        << "takeout_run_duration_seconds " << wallSeconds << "\n"
+        << "# HELP takeout_peak_rss_bytes Peak resident set size.\n"
+        << "# TYPE takeout_peak_rss_bytes gauge\n"
+        << "takeout_peak_rss_bytes " << peakResidentSetBytes() << "\n";
+
+    out << "# HELP takeout_phase_seconds_total Wall time per phase, summed over threads.\n"
+        << "# TYPE takeout_phase_seconds_total counter\n";
+    for (size_t i = 0; i < static_cast<size_t>(Phase::Count); ++i)
+        out << "takeout_phase_seconds_total{phase=\"" << phaseNames[i] << "\"} " << merged.wallSeconds[i] << "\n";
+    out << "# HELP takeout_phase_cpu_seconds_total Estimated CPU time per phase, summed over threads.\n"
+        << "# TYPE takeout_phase_cpu_seconds_total counter\n";
+    for (size_t i = 0; i < static_cast<size_t>(Phase::Count); ++i)
+        out << "takeout_phase_cpu_seconds_total{phase=\"" << phaseNames[i] << "\"} " << merged.cpuSeconds[i] << "\n";
+
+    for (size_t i = 0; i < static_cast<size_t>(Counter::Count); ++i)
+    {
+        out << "# TYPE takeout_" << counterNames[i] << "_total counter\n"
+            << "takeout_" << counterNames[i] << "_total " << merged.counters[i] << "\n";
+    }
+
+    out << "# HELP takeout_errors_total Errors reported, by class.\n"
+        << "# TYPE takeout_errors_total counter\n";
+    for (size_t i = 0; i < static_cast<size_t>(ErrorCode::Count); ++i)
+    {
+        ErrorCode code = static_cast<ErrorCode>(i);
+        out << "takeout_errors_total{class=\"" << errorCodeName(code) << "\"} " << errorCount(code) << "\n";
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <cstdint>
+#include <ostream>
+
+enum class Phase
+{
+    Walk,
+    Read,
+    Parse,
+    Resolve,
+    Apply,
+    Output,
+    Count
+};
+
+enum class Counter
+{
+    FilesSeen,
+    DirectoriesRead,
+    SidecarsParsed,
+    CompanionsMatched,
+    BytesRead,
+    StatCalls,            // Existence checks (stat)
+    OpenCalls,
+    ReadCalls,
+    WriteCalls,           // In-place metadata writes (pwrite)
+    CloseCalls,
+    SetTimesCalls,        // utimensat, or SetFileTime on Windows
+    SetCreationTimeCalls, // setattrlist (macOS)
+    TagCalls,             // Finder tag reads and writes (macOS)
+    ExifDatesWritten,     // '--write-exif' updates
+    VideoDatesWritten,    // '--write-video-dates' updates
+    Count
+};
+
+void enableStats();
+bool statsEnabled();
+void countEvent(Counter counter, uint64_t amount = 1);
+void printStats(std::ostream &out, double wallSeconds);
+void writeStatsJSON(std::ostream &out, double wallSeconds);
+void writeStatsPrometheus(std::ostream &out, double wallSeconds, bool complete);
+
+/**
+ * Adds the wall time (and, for a sample of instances, the thread CPU time) of a scope to a phase.
+ * Does nothing unless stats are enabled.
+ */
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(Phase phase);
+    ~PhaseTimer();
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+    Phase phase_;
+    bool active_ = false;
+    bool sampleCpu_ = false;
+    int64_t wallStart_ = 0;
+    int64_t cpuStart_ = 0;
+};
+
+#endif
@@ -0,0 +1,328 @@
+#include "sidecar.h"
+#include "json_scan.h"
+#include "error_log.h"
+#include "latency.h"
+#include "progress.h"
+#include "run_stats.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+/**
+ * Checks whether a file name looks like a Google Photos metadata sidecar.
+ * @param filename The file name (without directory).
+ * @return True for names containing '.supplemental-metadata.json' or '.suppl.json'.
+ */
+bool isSidecarName(const std::string &filename)
+{
+    if (filename.size() < 5 || filename.compare(filename.size() - 5, 5, ".json") != 0)
+        return false;
+    return filename.find(".supplemental-metadata.json") != std::string::npos ||
+           filename.find(".suppl.json") != std::string::npos;
+}
+
+/**
+ * Derives the name of the media file described by a sidecar.
+ * @param jsonFileName The sidecar file name (e.g. "IMG_7014.HEIC.supplemental-metadata.json").
+ * @param baseFileName Receives the media file name (e.g. "IMG_7014.HEIC").
+ * @param kind If not null, receives which suffix the name has.
+ * @return True if the name has a recognized sidecar suffix.
+ */
+bool sidecarBaseName(const std::string &jsonFileName, std::string &baseFileName, SidecarKind *kind)
+{
+    SidecarKind found = SidecarKind::SupplementalMetadata;
+    size_t pos = jsonFileName.find(".supplemental-metadata.json");
+    if (pos == std::string::npos)
+    {
+        found = SidecarKind::Suppl;
+        pos = jsonFileName.find(".suppl.json");
+    }
+    if (pos == std::string::npos)
+        return false;
+    baseFileName = jsonFileName.substr(0, pos);
+    if (kind)
+        *kind = found;
+    return true;
+}
+
+/**
+ * Reads a whole file into a buffer.
+ * On POSIX this is open, fstat, one read and close; std::ifstream would add three lseek calls per sidecar.
+ * @param path The file to read.
+ * @param buffer Receives the contents; its capacity is reused across calls.
+ * @return True on success; errno describes the failure otherwise.
+ */
+static bool readFile(const fs::path &path, std::string &buffer)
+{
+    PhaseTimer timer(Phase::Read);
+    countEvent(Counter::OpenCalls);
+#ifdef _WIN32
+    std::ifstream in;
+    {
+        IoTimer ioTimer(IoClass::Open);
+        in.open(path, std::ios::binary);
+    }
+    if (!in.is_open())
+        return false;
+    countEvent(Counter::ReadCalls);
+    countEvent(Counter::CloseCalls);
+    IoTimer ioTimer(IoClass::Read);
+    in.seekg(0, std::ios::end);
+    std::streamoff size = in.tellg();
+    if (size < 0)
+        return false;
+    in.seekg(0, std::ios::beg);
+    buffer.resize(static_cast<size_t>(size));
+    countEvent(Counter::BytesRead, static_cast<uint64_t>(size));
+    addProgressBytes(static_cast<uint64_t>(size));
+    return size == 0 || static_cast<bool>(in.read(&buffer[0], size));
+#else
+    int fd;
+    {
+        IoTimer ioTimer(IoClass::Open);
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0)
+        return false;
+    countEvent(Counter::ReadCalls);
+    countEvent(Counter::CloseCalls);
+    IoTimer ioTimer(IoClass::Read);
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0;
+    size_t size = ok ? static_cast<size_t>(info.st_size) : 0;
+    buffer.resize(size);
+    size_t done = 0;
+    while (ok && done < size)
+    {
+        ssize_t count = read(fd, &buffer[done], size - done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+        {
+            // A file that shrank while being read is treated as truncated JSON by the parser
+            ok = count == 0;
+            buffer.resize(done);
+            break;
+        }
+        done += static_cast<size_t>(count);
+    }
+    int savedErrno = errno;
+    close(fd);
+    errno = savedErrno;
+    countEvent(Counter::BytesRead, done);
+    addProgressBytes(done);
+    return ok;
+#endif
+}
+
+/**
+ * Extracts an integer "<object>.timestamp" field without throwing. Takeout writes timestamps as decimal
+ * strings; plain JSON integers are accepted too.
+ * @param j The parsed sidecar.
+ * @param field The object key (e.g. "photoTakenTime").
+ * @param value Receives the timestamp.
+ * @return SidecarStatus::Ok, MissingField or BadValue.
+ */
+static SidecarStatus extractTimestamp(const json &j, const char *field, time_t &value)
+{
+    auto object = j.find(field);
+    if (object == j.end() || !object->is_object())
+        return SidecarStatus::MissingField;
+    auto timestamp = object->find("timestamp");
+    if (timestamp == object->end())
+        return SidecarStatus::MissingField;
+
+    if (timestamp->is_number_integer())
+    {
+        value = static_cast<time_t>(timestamp->get<int64_t>());
+        return SidecarStatus::Ok;
+    }
+    if (!timestamp->is_string())
+        return SidecarStatus::BadValue;
+    const std::string &text = timestamp->get_ref<const std::string &>();
+    int64_t parsed = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size())
+        return SidecarStatus::BadValue;
+    value = static_cast<time_t>(parsed);
+    return SidecarStatus::Ok;
+}
+
+/**
+ * Parses sidecar JSON text into timestamps and people names. Never throws: damaged sidecars are classified
+ * and reported through reportError().
+ * @param text The sidecar contents.
+ * @param jsonPath Path of the sidecar, for error reports.
+ * @param meta Receives the timestamps and people names (primaryPath is left unchanged).
+ * @return SidecarStatus::Ok, MissingField, BadValue or ParseError.
+ */
+SidecarStatus parseSidecar(const std::string &text, const fs::path &jsonPath, SidecarMetadata &meta)
+{
+    PhaseTimer timer(Phase::Parse);
+    json j = json::parse(text, nullptr, false);
+    if (j.is_discarded() || !j.is_object())
+    {
+        reportError(ErrorCode::ParseFailed, 0, jsonPath.string(), "not a valid JSON object");
+        return SidecarStatus::ParseError;
+    }
+
+    for (const auto &field : {std::make_pair("photoTakenTime", &meta.photoTakenTime),
+                              std::make_pair("creationTime", &meta.creationTime)})
+    {
+        SidecarStatus status = extractTimestamp(j, field.first, *field.second);
+        if (status == SidecarStatus::MissingField)
+        {
+            reportError(ErrorCode::MissingField, 0, jsonPath.string(), std::string("no ") + field.first + ".timestamp");
+            return status;
+        }
+        if (status == SidecarStatus::BadValue)
+        {
+            reportError(ErrorCode::BadValue, 0, jsonPath.string(), std::string(field.first) + ".timestamp is not an integer");
+            return status;
+        }
+    }
+
+    meta.peopleNames.clear();
+    auto people = j.find("people");
+    if (people != j.end() && people->is_array())
+    {
+        for (const auto &person : *people)
+        {
+            if (!person.is_object())
+                continue;
+            auto name = person.find("name");
+            if (name != person.end() && name->is_string())
+                meta.peopleNames.push_back(name->get<std::string>());
+        }
+    }
+    countEvent(Counter::SidecarsParsed);
+    return SidecarStatus::Ok;
+}
+
+/**
+ * Reads and parses a sidecar file into its primary path, timestamps and people names.
+ * Never throws: damaged sidecars are classified, reported through reportError() and skipped.
+ * @param jsonPath Path to the metadata JSON file.
+ * @param meta Receives the extracted metadata.
+ * @param rawFields Dotted member paths (see findJSONMember()) whose values are copied from the file's
+ *                  bytes into meta.rawValues.
+ * @return SidecarStatus::Ok on success, otherwise why the sidecar was skipped.
+ */
+SidecarStatus readSidecar(const fs::path &jsonPath, SidecarMetadata &meta, const std::vector<std::string> &rawFields)
+{
+    std::string baseFileName;
+    if (!sidecarBaseName(jsonPath.filename().string(), baseFileName, &meta.sidecarKind))
+        return SidecarStatus::Unreadable; // Not a recognized metadata file
+
+    thread_local std::string buffer;
+    if (!readFile(jsonPath, buffer))
+    {
+        reportError(ErrorCode::SidecarOpenFailed, errno, jsonPath.string());
+        return SidecarStatus::Unreadable;
+    }
+
+    SidecarStatus status = parseSidecar(buffer, jsonPath, meta);
+    if (status != SidecarStatus::Ok)
+        return status;
+    meta.primaryPath = jsonPath.parent_path() / baseFileName;
+
+    meta.rawValues.assign(rawFields.size(), std::string());
+    for (size_t i = 0; i < rawFields.size(); ++i)
+    {
+        JSONSpan value;
+        if (findJSONMember(buffer.data(), buffer.data() + buffer.size(), rawFields[i], value))
+            appendCompactJSON(meta.rawValues[i], value);
+    }
+    return status;
+}
+
+/**
+ * Returns the name used for a sidecar status in summaries.
+ * @param status The status.
+ * @return A short lowercase name.
+ */
+const char *sidecarStatusName(SidecarStatus status)
+{
+    switch (status)
+    {
+    case SidecarStatus::Ok:
+        return "ok";
+    case SidecarStatus::MissingField:
+        return "missing-field";
+    case SidecarStatus::BadValue:
+        return "bad-value";
+    case SidecarStatus::ParseError:
+        return "parse-error";
+    default:
+        return "unreadable";
+    }
+}
+
+/**
+ * Checks whether a path exists without throwing.
+ * @param path The path to check.
+ * @return True if the path exists.
+ */
+bool pathExists(const fs::path &path)
+{
+    countEvent(Counter::StatCalls);
+    IoTimer ioTimer(IoClass::Stat);
+    std::error_code ec;
+    return fs::exists(path, ec);
+}
+
+/**
+ * Looks for a companion video (e.g. the '.MP4' part of a Live Photo) next to a primary file.
+ * A companion only counts if it has no sidecar of its own.
+ * @param primaryPath Path to the primary media file.
+ * @param extension Companion extension including the dot (e.g. ".MP4").
+ * @param companionPath Receives the companion path if found.
+ * @return True if the companion exists and lacks its own metadata.
+ */
+bool findCompanion(const fs::path &primaryPath, const std::string &extension, fs::path &companionPath)
+{
+    fs::path parentDir = primaryPath.parent_path();
+    std::string primaryStem = primaryPath.stem().string();
+    fs::path candidate = parentDir / (primaryStem + extension);
+    if (!pathExists(candidate) ||
+        pathExists(parentDir / (primaryStem + extension + ".supplemental-metadata.json")) ||
+        pathExists(parentDir / (primaryStem + extension + ".suppl.json")))
+        return false;
+    companionPath = candidate;
+    return true;
+}
+
+/**
+ * Collects the companion videos of a primary file: '.MP4' and '.mp4', counting the lowercase one only if
+ * it is a different file (on case-insensitive file systems both names resolve to the same video).
+ * @param primaryPath Path to the primary media file.
+ * @param companions The companion paths are appended to this.
+ */
+void findCompanions(const fs::path &primaryPath, std::vector<fs::path> &companions)
+{
+    size_t found = companions.size();
+    fs::path mp4Path, mp4LowerPath;
+    bool hasUpper = findCompanion(primaryPath, ".MP4", mp4Path);
+    if (hasUpper)
+        companions.push_back(mp4Path);
+    if (findCompanion(primaryPath, ".mp4", mp4LowerPath))
+    {
+        std::error_code ec;
+        countEvent(Counter::StatCalls, hasUpper ? 2 : 0);
+        if (!(hasUpper && fs::equivalent(mp4LowerPath, mp4Path, ec)))
+            companions.push_back(mp4LowerPath);
+    }
+    countEvent(Counter::CompanionsMatched, companions.size() - found);
+}
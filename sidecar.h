@@ -0,0 +1,72 @@
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * Naming scheme of a sidecar file.
+ */
+enum class SidecarKind
+{
+    SupplementalMetadata, // "<media>.supplemental-metadata.json"
+    Suppl,                // "<media>.suppl.json"
+    None                  // No sidecar: a video dated from its own metadata (ScanOptions::videoFallback)
+};
+
+/**
+ * Metadata extracted from a Google Photos sidecar JSON file.
+ */
+struct SidecarMetadata
+{
+    std::filesystem::path primaryPath;     // Media file the sidecar describes
+    SidecarKind sidecarKind = SidecarKind::SupplementalMetadata; // Suffix of the sidecar name
+    time_t photoTakenTime = 0;             // "photoTakenTime" timestamp
+    time_t creationTime = 0;               // "creationTime" (upload) timestamp
+    std::vector<std::string> peopleNames;  // "people[].name" entries
+    std::vector<std::string> rawValues;    // Compact JSON of the requested members, empty where absent
+};
+
+/**
+ * One media file (primary or companion video) with the metadata of its sidecar.
+ */
+struct MediaRecord
+{
+    std::string path;
+    time_t photoTakenTime = 0;
+    time_t creationTime = 0;
+    std::vector<std::string> peopleNames;
+    std::vector<std::string> rawValues; // Sidecar members requested in ScanOptions::rawFields
+    bool companion = false;             // A companion video rather than the file the sidecar names
+    SidecarKind sidecarKind = SidecarKind::SupplementalMetadata;
+    std::string exifDateTime;   // EXIF DateTimeOriginal if ScanOptions::readExif found one, else empty
+    std::string exifOffsetTime; // EXIF OffsetTimeOriginal, or empty
+};
+
+/**
+ * Outcome of reading a sidecar.
+ */
+enum class SidecarStatus
+{
+    Ok,
+    MissingField, // photoTakenTime or creationTime (or their timestamp) is absent
+    BadValue,     // A timestamp is present but not an integer
+    ParseError,   // Not valid JSON
+    Unreadable,   // Could not be opened or read
+    Count
+};
+
+bool isSidecarName(const std::string &filename);
+bool sidecarBaseName(const std::string &jsonFileName, std::string &baseFileName, SidecarKind *kind = nullptr);
+SidecarStatus parseSidecar(const std::string &text, const std::filesystem::path &jsonPath, SidecarMetadata &meta);
+SidecarStatus readSidecar(const std::filesystem::path &jsonPath, SidecarMetadata &meta,
+                          const std::vector<std::string> &rawFields = std::vector<std::string>());
+const char *sidecarStatusName(SidecarStatus status);
+bool findCompanion(const std::filesystem::path &primaryPath, const std::string &extension,
+                   std::filesystem::path &companionPath);
+void findCompanions(const std::filesystem::path &primaryPath, std::vector<std::filesystem::path> &companions);
+bool pathExists(const std::filesystem::path &path);
+
+#endif
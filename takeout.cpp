@@ -0,0 +1,311 @@
+#include "takeout.h"
+#include "error_log.h"
+#include "exif.h"
+#include "latency.h"
+#include "media_file.h"
+#include "mp4_times.h"
+#include "ordered_pipeline.h"
+#include "output_writer.h"
+#include "run_stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include "mac_tags.h"
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @return True if the actions change nothing.
+ */
+bool ApplyActions::empty() const
+{
+    return !setDates && !writeExifDates && !writeVideoDates && !assignAllPeopleTags && peopleTagsToAssign.empty() && !removeAllTags && tagsToRemove.empty();
+}
+
+/**
+ * Sets the creation and modification times of a file (platform-specific).
+ * @param filePath The path to the file.
+ * @param photoTakenTime The timestamp for the creation time.
+ * @param creationTime The timestamp for the modification time (upload time).
+ * @return True if successful, false otherwise.
+ */
+bool setFileTimes(const fs::path &filePath, time_t photoTakenTime, time_t creationTime)
+{
+#ifdef _WIN32
+    // Windows-specific: Use CreateFileA and SetFileTime
+    countEvent(Counter::OpenCalls);
+    HANDLE hFile;
+    {
+        IoTimer ioTimer(IoClass::Open);
+        hFile = CreateFileA(filePath.string().c_str(), GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        reportError(ErrorCode::TargetOpenFailed, static_cast<int>(GetLastError()), filePath.string());
+        return false;
+    }
+    FILETIME ftCreation, ftModification;
+    LONGLONG llCreation = Int32x32To64(photoTakenTime, 10000000) + 116444736000000000LL;
+    LONGLONG llModification = Int32x32To64(creationTime, 10000000) + 116444736000000000LL;
+    ftCreation.dwLowDateTime = (DWORD)llCreation;
+    ftCreation.dwHighDateTime = (DWORD)(llCreation >> 32);
+    ftModification.dwLowDateTime = (DWORD)llModification;
+    ftModification.dwHighDateTime = (DWORD)(llModification >> 32);
+    countEvent(Counter::SetTimesCalls);
+    BOOL timesSet;
+    {
+        IoTimer ioTimer(IoClass::SetTimes);
+        timesSet = SetFileTime(hFile, &ftCreation, NULL, &ftModification);
+    }
+    if (!timesSet)
+    {
+        reportError(ErrorCode::SetTimesFailed, static_cast<int>(GetLastError()), filePath.string());
+        countEvent(Counter::CloseCalls);
+        CloseHandle(hFile);
+        return false;
+    }
+    countEvent(Counter::CloseCalls);
+    CloseHandle(hFile);
+    return true;
+#else
+    // POSIX (Linux/macOS)
+    struct timespec times[2];
+    times[0].tv_sec = UTIME_OMIT; // Leave access time unchanged
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = creationTime; // Modification time (upload time)
+    times[1].tv_nsec = 0;
+
+    // utimensat needs no open file; it fails with EACCES/EPERM/ENOENT on its own
+    countEvent(Counter::SetTimesCalls);
+    int result;
+    {
+        IoTimer ioTimer(IoClass::SetTimes);
+        result = utimensat(AT_FDCWD, filePath.string().c_str(), times, 0);
+    }
+    if (result != 0)
+    {
+        reportError(ErrorCode::SetTimesFailed, errno, filePath.string());
+        return false;
+    }
+#ifdef __APPLE__
+    // macOS-specific: Set creation time
+    countEvent(Counter::SetCreationTimeCalls);
+    if (!setCreationTime(filePath.string(), photoTakenTime))
+    {
+        return false;
+    }
+#endif
+    return true;
+#endif
+}
+
+/**
+ * Applies actions to the media file of a record: the EXIF or movie header dates, then the file dates, then
+ * the tag actions.
+ * Failures are reported through reportError().
+ * @param record The file and its sidecar metadata.
+ * @param actions The changes to make.
+ * @return True if every action succeeded.
+ */
+bool applyActions(const MediaRecord &record, const ApplyActions &actions)
+{
+    PhaseTimer timer(Phase::Apply);
+    bool ok = true;
+    // Writing embedded dates touches the file, so it goes before the file dates are set; without
+    // setDates the file keeps the dates it had
+    if (actions.writeExifDates && !record.companion && isExifImageName(record.path))
+    {
+        switch (writeExifDateTime(record.path, record.photoTakenTime, !actions.setDates))
+        {
+        case ExifWriteStatus::Written:
+            countEvent(Counter::ExifDatesWritten);
+            break;
+        case ExifWriteStatus::Unchanged:
+            break;
+        case ExifWriteStatus::NotInPlace:
+            reportError(ErrorCode::ExifNotInPlace, 0, record.path);
+            ok = false;
+            break;
+        case ExifWriteStatus::NoOffset:
+            reportError(ErrorCode::ExifNoOffset, 0, record.path);
+            ok = false;
+            break;
+        case ExifWriteStatus::Failed:
+            reportError(ErrorCode::MediaWriteFailed, lastMediaFileError(), record.path);
+            ok = false;
+            break;
+        }
+    }
+    // Videos dated from their own header (ScanOptions::videoFallback) already hold their time
+    if (actions.writeVideoDates && record.sidecarKind != SidecarKind::None && isVideoName(record.path))
+    {
+        switch (writeMovieTimes(record.path, record.photoTakenTime, !actions.setDates))
+        {
+        case MovieWriteStatus::Written:
+            countEvent(Counter::VideoDatesWritten);
+            break;
+        case MovieWriteStatus::Unchanged:
+            break;
+        case MovieWriteStatus::NotInPlace:
+            reportError(ErrorCode::MovieNotInPlace, 0, record.path);
+            ok = false;
+            break;
+        case MovieWriteStatus::Failed:
+            reportError(ErrorCode::MediaWriteFailed, lastMediaFileError(), record.path);
+            ok = false;
+            break;
+        }
+    }
+    if (actions.setDates)
+        ok = setFileTimes(record.path, record.photoTakenTime, record.creationTime) && ok;
+#ifdef __APPLE__
+    if (!actions.peopleTagsToAssign.empty())
+    {
+        std::vector<std::string> tagsToApply;
+        for (const auto &tag : actions.peopleTagsToAssign)
+        {
+            if (std::find(record.peopleNames.begin(), record.peopleNames.end(), tag) != record.peopleNames.end())
+            {
+                tagsToApply.push_back(tag);
+            }
+        }
+        if (!tagsToApply.empty())
+            ok = setFinderTags(record.path, tagsToApply) && ok;
+    }
+    if (actions.assignAllPeopleTags && !record.peopleNames.empty())
+        ok = setFinderTags(record.path, record.peopleNames) && ok;
+    if (actions.removeAllTags)
+        ok = removeAllFinderTags(record.path) && ok;
+    if (!actions.tagsToRemove.empty())
+        ok = removeNamedFinderTags(record.path, actions.tagsToRemove) && ok;
+#endif
+    return ok;
+}
+
+/**
+ * Reads a sidecar and appends the records for its primary file and companion videos.
+ * Supports .supplemental-metadata.json and .suppl.json suffixes.
+ * @param jsonPath Path to the metadata JSON file.
+ * @param options Which lookups to make.
+ * @param batch Receives the records and the sidecar status count.
+ */
+static void scanSidecar(const fs::path &jsonPath, const ScanOptions &options, WorkBatch &batch)
+{
+    SidecarMetadata meta;
+    SidecarStatus status = readSidecar(jsonPath, meta, options.rawFields);
+    ++batch.sidecarStatusCounts[static_cast<size_t>(status)];
+    if (status != SidecarStatus::Ok)
+        return;
+
+    // The primary file followed by its companion videos
+    std::vector<fs::path> targets;
+    {
+        PhaseTimer timer(Phase::Resolve);
+        if (options.requirePrimary && !pathExists(meta.primaryPath))
+        {
+            reportError(ErrorCode::PrimaryMissing, ENOENT, meta.primaryPath.string());
+            return;
+        }
+        targets.push_back(meta.primaryPath);
+        if (options.companions)
+            findCompanions(meta.primaryPath, targets);
+    }
+
+    size_t first = batch.records.size();
+    for (size_t i = 0; i + 1 < targets.size(); ++i)
+        batch.records.push_back({targets[i].string(), meta.photoTakenTime, meta.creationTime, meta.peopleNames, meta.rawValues});
+    batch.records.push_back({targets.back().string(), meta.photoTakenTime, meta.creationTime, std::move(meta.peopleNames),
+                             std::move(meta.rawValues)});
+    for (size_t i = first; i < batch.records.size(); ++i)
+    {
+        batch.records[i].companion = i != first;
+        batch.records[i].sidecarKind = meta.sidecarKind;
+    }
+
+    if (options.readExif && isExifImageName(batch.records[first].path))
+    {
+        ExifDates dates;
+        if (readExifDates(batch.records[first].path, dates) == ExifStatus::Unreadable)
+            reportError(ErrorCode::MediaReadFailed, lastMediaFileError(), batch.records[first].path);
+        batch.records[first].exifDateTime = std::move(dates.dateTimeOriginal);
+        batch.records[first].exifOffsetTime = std::move(dates.offsetTimeOriginal);
+    }
+
+    if (options.actions.empty())
+        return;
+    for (size_t i = first; i < batch.records.size(); ++i)
+        applyActions(batch.records[i], options.actions);
+}
+
+/**
+ * Appends a record for a video without a sidecar, dated from its movie header: the creation time stands in
+ * for the photo taken time and the modification time for the upload time. Videos without a creation time
+ * are skipped.
+ * @param videoPath The video.
+ * @param options Which lookups to make.
+ * @param batch Receives the record.
+ */
+static void scanVideo(const fs::path &videoPath, const ScanOptions &options, WorkBatch &batch)
+{
+    MovieHeader header;
+    MovieStatus status = readMovieHeader(videoPath, header);
+    if (status == MovieStatus::Unreadable)
+        reportError(ErrorCode::MediaReadFailed, lastMediaFileError(), videoPath.string());
+    if (status != MovieStatus::Found)
+        return;
+
+    MediaRecord record;
+    record.path = videoPath.string();
+    record.photoTakenTime = header.creationTime;
+    record.creationTime = header.modificationTime;
+    record.rawValues.resize(options.rawFields.size());
+    record.sidecarKind = SidecarKind::None;
+    batch.records.push_back(std::move(record));
+    if (!options.actions.empty())
+        applyActions(batch.records.back(), options.actions);
+}
+
+/**
+ * Scans a Takeout folder for sidecars and delivers a record for each media file they describe, applying
+ * the requested actions on the way (and, with ScanOptions::videoFallback, for videos no sidecar describes). Errors are counted and reported through reportError() (see
+ * setErrorHandler()); nothing is written to std::cout.
+ * @param root The Takeout folder.
+ * @param options The thread count, lookups and actions.
+ * @param onRecords Called with the records of each batch, in traversal order and on one thread at a time.
+ * @return Number of sidecars seen per status.
+ */
+SidecarStatusCounts scanTakeout(const fs::path &root, const ScanOptions &options, const RecordHandler &onRecords)
+{
+    SidecarStatusCounts totals{};
+    runOrderedPipeline(
+        root, std::max(options.jobs, 1u), options.videoFallback,
+        [&options](WorkBatch &batch)
+        {
+            for (const auto &sidecar : batch.sidecars)
+                scanSidecar(sidecar, options, batch);
+            for (const auto &video : batch.videos)
+                scanVideo(video, options, batch);
+            flushThreadOutput();
+        },
+        [&](WorkBatch &batch)
+        {
+            if (onRecords && !batch.records.empty())
+                onRecords(batch.records);
+            for (size_t i = 0; i < totals.size(); ++i)
+                totals[i] += batch.sidecarStatusCounts[i];
+            flushThreadOutput(); // Errors reported by onRecords, such as a failed spill
+        });
+    return totals;
+}
@@ -0,0 +1,56 @@
+#ifndef TAKEOUT_H
+#define TAKEOUT_H
+
+#include "sidecar.h"
+
+#include <array>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Changes to make to the media files of a record. Tag actions only take effect on macOS.
+ */
+struct ApplyActions
+{
+    bool setDates = false;                       // Set file dates from the sidecar times
+    bool writeExifDates = false;                 // Overwrite EXIF DateTimeOriginal of JPEG and HEIC primaries in place
+    bool writeVideoDates = false;                // Overwrite 'mvhd' and 'tkhd' times of videos with a sidecar in place
+    bool assignAllPeopleTags = false;            // Assign all people names as Finder Tags
+    std::vector<std::string> peopleTagsToAssign; // Assign those of these names the sidecar lists
+    bool removeAllTags = false;                  // Remove all Finder Tags
+    std::vector<std::string> tagsToRemove;       // Remove these Finder Tags
+
+    bool empty() const;
+};
+
+/**
+ * What scanTakeout() looks up for each sidecar and what it changes.
+ */
+struct ScanOptions
+{
+    unsigned jobs = 1;                  // Threads reading sidecars; records are still delivered in traversal order
+    bool requirePrimary = true;         // Skip sidecars whose media file is missing, reporting ErrorCode::PrimaryMissing
+    bool companions = true;             // Add records for companion videos (see findCompanions())
+    std::vector<std::string> rawFields; // Sidecar members copied into MediaRecord::rawValues (dotted paths)
+    bool readExif = false;              // Read the EXIF capture time of JPEG and HEIC primary files
+    bool videoFallback = false;         // Add records for videos without a sidecar, dated from their 'mvhd' box
+    ApplyActions actions;               // Applied to every record on the worker threads before it is delivered
+};
+
+using SidecarStatusCounts = std::array<size_t, static_cast<size_t>(SidecarStatus::Count)>;
+
+/**
+ * Receives the records of one directory batch. Batches arrive in traversal order on a single thread, which
+ * may move the records out of the vector.
+ */
+using RecordHandler = std::function<void(std::vector<MediaRecord> &records)>;
+
+SidecarStatusCounts scanTakeout(const std::filesystem::path &root, const ScanOptions &options,
+                                const RecordHandler &onRecords);
+bool applyActions(const MediaRecord &record, const ApplyActions &actions);
+bool setFileTimes(const std::filesystem::path &filePath, time_t photoTakenTime, time_t creationTime);
+
+#endif
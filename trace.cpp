@@ -0,0 +1,182 @@
+#include "trace.h"
+#include "format.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // Events kept per thread; later events are counted as dropped so a long run cannot exhaust memory.
+    const size_t maxEventsPerThread = size_t(1) << 20;
+
+    /**
+     * A completed span ('ph':'X' in the trace-event format).
+     */
+    struct TraceEvent
+    {
+        const char *name;
+        int64_t startNs;
+        int64_t durationNs;
+        std::string detail;
+    };
+
+    /**
+     * Events of one thread. Only the owning thread appends, so recording takes no lock;
+     * the buffers are read after all threads have finished.
+     */
+    struct ThreadTrace
+    {
+        size_t id = 0;
+        std::string name;
+        std::vector<TraceEvent> events;
+        uint64_t spanCount = 0;
+        uint64_t dropped = 0;
+    };
+
+    std::atomic<bool> enabled(false);
+    unsigned sampleEvery = 1;
+    int64_t traceStartNs = 0;
+    std::mutex registryMutex; // Only taken once per thread, when it first records something
+    std::vector<std::unique_ptr<ThreadTrace>> registry;
+}
+
+/**
+ * @return Monotonic wall clock in nanoseconds (the clock PhaseTimer uses).
+ */
+static int64_t steadyNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Returns the calling thread's event buffer, registering it on first use.
+ */
+static ThreadTrace &threadTrace()
+{
+    thread_local ThreadTrace *trace = nullptr;
+    if (!trace)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.emplace_back(new ThreadTrace());
+        trace = registry.back().get();
+        trace->id = registry.size();
+        trace->name = "thread " + std::to_string(trace->id);
+    }
+    return *trace;
+}
+
+/**
+ * Appends an event to the calling thread's buffer.
+ */
+static void record(ThreadTrace &trace, const char *name, int64_t startNs, int64_t durationNs, std::string detail)
+{
+    if (trace.events.size() >= maxEventsPerThread)
+    {
+        ++trace.dropped;
+        return;
+    }
+    trace.events.push_back({name, startNs - traceStartNs, durationNs, std::move(detail)});
+}
+
+/**
+ * Turns on span recording. Call before any worker thread starts.
+ * @param sampleInterval Record one in this many per-file spans of each thread (1 = all).
+ */
+void startTrace(unsigned sampleInterval)
+{
+    sampleEvery = sampleInterval ? sampleInterval : 1;
+    traceStartNs = steadyNow();
+    enabled = true;
+}
+
+/**
+ * @return True if '--trace' is active.
+ */
+bool traceEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Names the calling thread in the trace (e.g. "worker 2").
+ * @param name The thread name shown by trace viewers.
+ */
+void nameTraceThread(const std::string &name)
+{
+    if (traceEnabled())
+        threadTrace().name = name;
+}
+
+/**
+ * Records a per-file span, subject to sampling.
+ * @param name The span name; must be a string literal or otherwise outlive the trace.
+ * @param startNs Start on the steady clock, in nanoseconds.
+ * @param durationNs Duration in nanoseconds.
+ */
+void traceSpan(const char *name, int64_t startNs, int64_t durationNs)
+{
+    if (!traceEnabled())
+        return;
+    ThreadTrace &trace = threadTrace();
+    if (trace.spanCount++ % sampleEvery == 0)
+        record(trace, name, startNs, durationNs, std::string());
+}
+
+/**
+ * Starts a span.
+ * @param name The span name; must be a string literal or otherwise outlive the trace.
+ * @param detail Shown as the span's "detail" argument (e.g. the directory of a batch); may be empty.
+ */
+TraceScope::TraceScope(const char *name, std::string detail) : name_(name)
+{
+    if (!traceEnabled())
+        return;
+    detail_ = std::move(detail);
+    start_ = steadyNow();
+}
+
+/**
+ * Ends the span and records it.
+ */
+TraceScope::~TraceScope()
+{
+    if (start_)
+        record(threadTrace(), name_, start_, steadyNow() - start_, std::move(detail_));
+}
+
+/**
+ * Writes all recorded spans in the Chrome trace-event JSON format (loadable in chrome://tracing and Perfetto).
+ * Call only after every traced thread has finished.
+ * @param out The stream to write to.
+ */
+void writeTrace(std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    const char *separator = "";
+    for (const auto &trace : registry)
+    {
+        out << separator << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << trace->id
+            << ",\"args\":{\"name\":" << escapeJSON(trace->name) << "}}";
+        separator = ",\n";
+        if (trace->dropped)
+        {
+            out << separator << "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"dropped " << trace->dropped
+                << " events\",\"pid\":1,\"tid\":" << trace->id << ",\"ts\":0}";
+        }
+        for (const auto &event : trace->events)
+        {
+            // Timestamps are microseconds; keep nanosecond resolution in the fraction
+            out << separator << "{\"ph\":\"X\",\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << trace->id
+                << ",\"ts\":" << event.startNs / 1000 << "." << std::to_string(1000 + event.startNs % 1000).substr(1)
+                << ",\"dur\":" << event.durationNs / 1000 << "." << std::to_string(1000 + event.durationNs % 1000).substr(1);
+            if (!event.detail.empty())
+                out << ",\"args\":{\"detail\":" << escapeJSON(event.detail) << "}";
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+}
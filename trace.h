@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+void startTrace(unsigned sampleInterval);
+bool traceEnabled();
+void nameTraceThread(const std::string &name);
+void traceSpan(const char *name, int64_t startNs, int64_t durationNs);
+void writeTrace(std::ostream &out);
+
+/**
+ * Records a scope as one trace span, unsampled. Meant for coarse units such as a batch of sidecars.
+ * Does nothing unless tracing is enabled.
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char *name, std::string detail);
+    ~TraceScope();
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name_;
+    std::string detail_;
+    int64_t start_ = 0;
+};
+
+#endif